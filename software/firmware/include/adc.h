@@ -8,6 +8,33 @@ using namespace ltc230x;
 
 
 #include "model.h"
+#include "protect.h"
+
+// Detector channels, ADC address and start-up calibration of one coupler
+// port. The trims and the divider can be changed at run time, see
+// Model::portSettings. The coupling and directivity curves in model.h are
+// shared by all ports.
+struct PortConfig
+{
+  channel::Channel fwd; // Forward detector channel
+  channel::Channel ref; // Reflected detector channel
+  address::Address addr; // LTC2309 address
+  int16_t fwdTrim;      // Forward detector offset in mV, added to the reading
+  int16_t refTrim;      // Reflected detector offset in mV, added to the reading
+  uint8_t divider;      // Read the port on every n:th round-robin turn
+};
+
+// Port configurations, the first PORT_COUNT are used.
+const PortConfig portConfigs[] = {
+    {channel::POSITIVE_0_NEGATIVE_COM, channel::POSITIVE_1_NEGATIVE_COM, address::AD1_LOW_AD0_LOW, 0, 0, 1},
+    {channel::POSITIVE_2_NEGATIVE_COM, channel::POSITIVE_3_NEGATIVE_COM, address::AD1_LOW_AD0_LOW, 0, 0, 1},
+    {channel::POSITIVE_4_NEGATIVE_COM, channel::POSITIVE_5_NEGATIVE_COM, address::AD1_LOW_AD0_LOW, 0, 0, 1},
+    {channel::POSITIVE_6_NEGATIVE_COM, channel::POSITIVE_7_NEGATIVE_COM, address::AD1_LOW_AD0_LOW, 0, 0, 1}};
+
+// Sample pairs of a reading between the protection checks of the other ports.
+#define ADC_POLL_PAIRS 8
+
+static_assert(PORT_COUNT >= 1 && PORT_COUNT <= sizeof(portConfigs) / sizeof(portConfigs[0]), "invalid PORT_COUNT");
 
 // The Adc class manages the interaction with multiple ADCs, reading voltage values
 // from RF detectors and diodes, and storing them in a Model instance.
@@ -15,41 +42,142 @@ class Adc
 {
 private:
   Model &m; // Reference to the model where ADC readings will be stored
+  Protect &protect; // SWR protection checking every raw sample pair
+
+  // Instances of LTC230x representing the forward and reflected ADC channels
+  // of each port for data acquisition
+  LTC230x ltc2309_fwd[PORT_COUNT];
+  LTC230x ltc2309_ref[PORT_COUNT];
 
-  // Instances of LTC230x representing different ADC channels for data acquisition
-  LTC230x ltc2309_ad0;
-  LTC230x ltc2309_ad1;
-  LTC230x ltc2309_ad2;
-  LTC230x ltc2309_ad3;
+  bool asleep = false; // ADC put to sleep for the idle mode
+  uint8_t port = PORT_COUNT - 1; // Port read last
+  uint8_t turns[PORT_COUNT] = {}; // Round-robin turns since each port was read
+  uint16_t readings = 0;         // Readings since the rate was last updated
+  unsigned long rateStart = 0;   // millis() when the rate was last updated
 
   /**
-   * @brief Reads averaged data from a specified ADC and shifts it to adjust precision.
+   * @brief Puts the ADC to sleep or wakes it up.
    *
-   * This function accumulates raw data from the ADC over a defined window (AWG_WINDOW),
-   * averages it, and shifts the result right by 4 bits for consistent scaling.
+   * The sleep bit is sent to the LTC2309 with the next conversion request, so
+   * one dummy conversion is made to apply the new mode right away.
    *
-   * @param ltc2309 The ADC from which to read.
-   * @return The processed and scaled data.
+   * @param sleepNow true to sleep, false to wake.
    */
-  uint16_t read(ltc230x::LTC230x &ltc2309)
+  void setSleep(bool sleepNow)
   {
-    uint32_t raw_data = 0;
-    for (int i = 0; i < AWG_WINDOW; i++)
+    if (sleepNow == asleep)
+      return;
+
+    const auto sleepMode = sleepNow ? sleep::SLEEP : sleep::WAKE;
+    for (uint8_t p = 0; p < PORT_COUNT; p++)
     {
-      raw_data += ltc2309.read_raw(); // Accumulate raw data from ADC
+      ltc2309_fwd[p].set_sleep_mode(sleepMode);
+      ltc2309_ref[p].set_sleep_mode(sleepMode);
+      ltc2309_fwd[p].read_raw();
     }
-    raw_data /= AWG_WINDOW; // Compute average
-    raw_data >>= 4; // Scale down by shifting
+    asleep = sleepNow;
+  }
 
-    if (raw_data > 3300)
-      raw_data = 3300; // Clamp to maximum ADC value
+  /**
+   * @brief Averages accumulated data keeping the oversampling resolution.
+   *
+   * The LTC2309 returns its 12-bit code, 1 mV per step, in the top bits of a
+   * 16-bit word, so the raw samples are already in 1/16 mV. Their sum over
+   * the window selected in the model (AWG_WINDOW by default) is averaged
+   * with rounding and kept in 1/16 mV, with the fraction bits gained by
+   * averaging.
+   *
+   * @param raw_data Sum of the raw data.
+   * @param trim Port calibration offset to add, in mV.
+   * @return The averaged voltage in 1/16 mV.
+   */
+  uint16_t average(uint32_t raw_data, int16_t trim)
+  {
+    raw_data = (raw_data + m.avgWindow / 2) / m.avgWindow; // Compute average
+    int32_t trimmed = static_cast<int32_t>(raw_data) + trim * ADC_SCALE; // Apply the port calibration
+    raw_data = trimmed < 0 ? 0 : trimmed;
 
-    if (raw_data < 400)
-      raw_data = 0; // Clamp to minimum ADC value
+    if (raw_data > 3300UL * ADC_SCALE)
+      raw_data = 3300UL * ADC_SCALE; // Clamp to maximum ADC value
 
     return raw_data;
   }
 
+  /**
+   * @brief Clamps a reading that is noise to zero.
+   *
+   * With the auto-zero on, noise is a reading within ZERO_MARGIN of the
+   * tracked noise floor, otherwise one below ZERO_FIXED_CLAMP.
+   *
+   * @param raw Averaged reading in 1/16 mV.
+   * @param floor Tracked noise floor of the detector in 1/16 mV, see zero.h.
+   * @return The reading, or 0 if it is noise.
+   */
+  uint16_t gate(uint16_t raw, uint16_t floor) const
+  {
+    uint16_t limit = m.zeroEnabled ? floor + ZERO_MARGIN * ADC_SCALE : ZERO_FIXED_CLAMP * ADC_SCALE;
+    return raw < limit ? 0 : raw;
+  }
+
+  /**
+   * @brief Selects the next port to read in round-robin order.
+   *
+   * Ports not enabled in the model's port mask are skipped, and a port is
+   * read only on every divider:th turn given in its configuration.
+   *
+   * @return true if a port is due, with its index in port.
+   */
+  bool nextPort()
+  {
+    for (uint8_t i = 0; i < PORT_COUNT; i++)
+    {
+      port = (port + 1) % PORT_COUNT;
+      if (!(m.portMask & (1 << port)))
+        continue;
+      if (++turns[port] < m.portSettings[port].divider)
+        continue;
+      turns[port] = 0;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Reads one sample pair of every enabled port for the SWR protection.
+   *
+   * The pairs are only checked by the protection, not added to a reading.
+   *
+   * @param skip Port not to read, PORT_COUNT for none.
+   * @return false if the bus timed out.
+   */
+  bool check(uint8_t skip)
+  {
+    for (uint8_t p = 0; p < PORT_COUNT; p++)
+    {
+      if (p == skip || !(m.portMask & (1 << p)))
+        continue;
+      uint16_t fwd = ltc2309_fwd[p].read_raw();
+      uint16_t ref = ltc2309_ref[p].read_raw();
+      if (Wire.getWireTimeoutFlag())
+        return false;
+      protect.check(fwd >> 4, ref >> 4);
+    }
+    return true;
+  }
+
+  // Counts the readings to give the aggregate reading rate per second.
+  void countReading()
+  {
+    readings++;
+    unsigned long elapsed = millis() - rateStart;
+    if (elapsed >= 1000)
+    {
+      m.readingRate = readings * 1000UL / elapsed;
+      readings = 0;
+      rateStart += elapsed;
+    }
+  }
+
 public:
   /**
    * @brief Constructor for the Adc class.
@@ -57,19 +185,34 @@ public:
    * Initializes an Adc instance with a reference to a Model object.
    *
    * @param model The model where ADC data will be stored.
+   * @param p The SWR protection to feed with the raw samples.
    */
-  Adc(Model &model) : m(model) {}
+  Adc(Model &model, Protect &p) : m(model), protect(p)
+  {
+    for (uint8_t i = 0; i < PORT_COUNT; i++)
+    {
+      m.portSettings[i].fwdTrim = portConfigs[i].fwdTrim;
+      m.portSettings[i].refTrim = portConfigs[i].refTrim;
+      m.portSettings[i].divider = portConfigs[i].divider;
+    }
+  }
 
   /**
    * @brief Initializes all connected ADCs.
    *
    * Each ADC is configured to read voltages using unipolar mode and set
-   * to wake mode with a specific channel configuration.
+   * to wake mode with the channel configuration of its port. Also used to
+   * set the ADCs up again after an I2C bus recovery.
    */
   inline void init()
   {
-    initializeADC(ltc2309_ad0, channel::POSITIVE_0_NEGATIVE_COM);
-    initializeADC(ltc2309_ad1, channel::POSITIVE_1_NEGATIVE_COM);
+    for (uint8_t p = 0; p < PORT_COUNT; p++)
+    {
+      initializeADC(ltc2309_fwd[p], portConfigs[p].fwd, portConfigs[p].addr);
+      initializeADC(ltc2309_ref[p], portConfigs[p].ref, portConfigs[p].addr);
+    }
+    asleep = false;
+    rateStart = millis();
   }
 
   /**
@@ -79,10 +222,10 @@ public:
    *
    * @param adc The ADC to configure.
    * @param ch The channel configuration to apply.
+   * @param addr The I2C address of the ADC.
    */
-  inline void initializeADC(LTC230x &adc, channel::Channel ch)
+  inline void initializeADC(LTC230x &adc, channel::Channel ch, address::Address addr)
   {
-    constexpr auto addr = address::AD1_LOW_AD0_LOW;
     constexpr auto mode = uni_bi::UNIPOLAR;
     constexpr auto sleepMode = sleep::WAKE;
 
@@ -95,18 +238,83 @@ public:
   /**
    * @brief Reads and stores ADC data into the model.
    *
-   * Continuously reads data from each ADC channel and updates the model's forward
-   * and reflected voltages, applying thresholds to filter noise.
+   * Reads the forward and reflected channels of the next port due and
+   * updates the port's voltages in the model, in 1/16 mV, clamping readings close to
+   * the port's tracked noise floor to zero. The reading is stamped with the local clock at acquisition time.
+   * The voltages of the port selected for display are also stored as the
+   * model's current voltages. Every ADC_POLL_PAIRS sample pairs the other
+   * enabled ports get a pair checked by the protection, so a long averaging
+   * window does not leave them unprotected. In the idle mode the ADC is kept
+   * asleep and nothing is read, except while the model asks for noise floor
+   * samples, see zero.h.
+   *
+   * @return true if a new reading was stored, false if no port was due or
+   *         the bus timed out.
    */
-  void loop()
+  bool loop()
   {
-    if (m.enc_changed)
-      return;
-      
-    // Read forward detector voltage 
-    m.fwdV = read(ltc2309_ad0);
+    bool sleeping = m.idle && !m.floorDue; // Woken while idle only for the floor samples
+    setSleep(sleeping);
+    if (m.enc_changed || sleeping || !nextPort())
+      return false;
+
+    const PortSetting &cfg = m.portSettings[port];
+    uint64_t start = m.micros64();
+    uint32_t fwdSum = 0;
+    uint32_t refSum = 0;
+
+    // Read the forward and reflected detectors in pairs so that the
+    // protection can check each pair as soon as it is read
+    for (uint16_t i = 0; i < m.avgWindow; i++)
+    {
+      uint16_t fwd = ltc2309_fwd[port].read_raw();
+      uint16_t ref = ltc2309_ref[port].read_raw();
+      if (Wire.getWireTimeoutFlag())
+        return false; // Bus stuck, drop the reading and leave it to the bus recovery
+      fwdSum += fwd;
+      refSum += ref;
+      protect.check(fwd >> 4, ref >> 4);
+#if PORT_COUNT > 1
+      if ((i + 1) % ADC_POLL_PAIRS == 0 && !check(port))
+        return false;
+#endif
+    }
+
+    // Forward and reflected detector voltages
+    PortReading &r = m.ports[port];
+    r.fwdRaw = average(fwdSum, cfg.fwdTrim);
+    r.refRaw = average(refSum, cfg.refTrim);
+    r.fwdV = gate(r.fwdRaw, r.fwdFloor);
+    r.refV = gate(r.refRaw, r.refFloor);
+    m.port = port;
+    if (port == m.selPort)
+    {
+      m.fwdV = r.fwdV;
+      m.refV = r.refV;
+    }
+
+    // Stamp the reading with the middle of the averaging window
+    m.sampleTime = start + (m.micros64() - start) / 2;
+    countReading();
+    return true;
+  }
 
-    // Read reflected detector voltage
-    m.refV = read(ltc2309_ad1);
+  /**
+   * @brief Reads one extra sample pair of each port for the SWR protection.
+   *
+   * Reads the forward and reflected detectors of every enabled port once
+   * and has the protection check the pairs, without adding them to a
+   * reading. Called between the phases of the loop that do not read the
+   * ADC, so the protection latency is not the whole loop, nor does it grow
+   * with the number of ports. Does nothing in the idle mode or while the bus
+   * has timed out.
+   *
+   * @return true if the pairs were checked.
+   */
+  bool poll()
+  {
+    if (asleep || m.idle || Wire.getWireTimeoutFlag())
+      return false;
+    return check(PORT_COUNT);
   }
 };
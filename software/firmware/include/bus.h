@@ -0,0 +1,171 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <avr/wdt.h>
+#include "model.h"
+#include "adc.h"
+#include "display.h"
+
+#define BUS_TIMEOUT_US 10000UL // Longest I2C transaction before it is aborted
+#define BUS_PULSES 9           // SCL pulses to free a device holding SDA low
+#define BUS_WATCHDOG WDTO_2S   // Watchdog reset when loop() stops for this long
+
+// Reset cause, MCUSR, saved before it is cleared at start-up.
+static uint8_t resetCause __attribute__((section(".noinit")));
+
+/**
+ * @brief Clears the watchdog reset flag and stops the watchdog at start-up.
+ *
+ * After a watchdog reset the watchdog stays enabled at its shortest timeout
+ * until WDRF is cleared, which would reset the MCU again before setup() is
+ * reached. Runs in .init3, before the C++ constructors.
+ */
+static void busInitWatchdog() __attribute__((naked, used, section(".init3")));
+static void busInitWatchdog()
+{
+  resetCause = MCUSR;
+  MCUSR = 0;
+  wdt_disable();
+}
+
+/**
+ * @brief Class to keep the I2C bus working when a transaction hangs.
+ *
+ * Every Wire transaction is limited to BUS_TIMEOUT_US, after which Wire
+ * resets the TWI hardware and flags the timeout. The main loop calls
+ * check() after each module using the bus, so the timeout is blamed on that
+ * device: the bus is freed by clocking SCL until the device lets go of SDA,
+ * followed by a STOP, and the device is initialized again. The errors and
+ * recoveries are counted in the model and reported as a JSON line.
+ *
+ * If the loop still hangs, the hardware watchdog resets the meter after
+ * BUS_WATCHDOG. The reset cause is kept in the model.
+ */
+class Bus
+{
+private:
+  Model &m;       // Reference to the Model object holding the counters
+  Adc &adc;       // ADCs to set up again after a recovery
+  Display &disp;  // Display to set up again after a recovery
+  bool armed = false; // Watchdog enabled
+
+  // Pulls an I2C line low. The PORT bit is cleared first, so the pin goes
+  // straight from released to low and never drives the line high.
+  static void pull(uint8_t pin)
+  {
+    digitalWrite(pin, LOW);
+    pinMode(pin, OUTPUT);
+  }
+
+  // Releases an I2C line to the bus pull-ups.
+  static void let(uint8_t pin)
+  {
+    pinMode(pin, INPUT);
+  }
+
+  /**
+   * @brief Frees SDA held low by a device stuck in the middle of a byte.
+   *
+   * Clocks SCL as an open drain line until SDA is released, sends a STOP
+   * condition and restarts Wire. The lines are only ever pulled low or
+   * released, as a device may be holding them low.
+   */
+  void release()
+  {
+    Wire.end();
+    let(SDA);
+    let(SCL);
+
+    for (uint8_t i = 0; i < BUS_PULSES && digitalRead(SDA) == LOW; i++)
+    {
+      pull(SCL);
+      delayMicroseconds(5);
+      let(SCL);
+      delayMicroseconds(5);
+    }
+
+    // STOP: SDA rises while SCL is high
+    pull(SCL);
+    pull(SDA);
+    delayMicroseconds(5);
+    let(SCL);
+    delayMicroseconds(5);
+    let(SDA);
+
+    Wire.begin();
+    Wire.setClock(I2C_CLOCK_HZ);
+    Wire.setWireTimeout(BUS_TIMEOUT_US, true);
+  }
+
+  // Reports the error and recovery counters.
+  void report()
+  {
+    Serial.print(F("{\"bus\":"));
+    Serial.print(m.busRecoveries);
+    Serial.print(F(",\"ae\":"));
+    Serial.print(m.busErrors[BUS_ADC]);
+    Serial.print(F(",\"de\":"));
+    Serial.print(m.busErrors[BUS_DISP]);
+    Serial.println(F("}"));
+  }
+
+public:
+  /**
+   * @brief Constructor for the Bus class.
+   *
+   * @param model The model holding the counters.
+   * @param a The ADCs to set up again after a recovery.
+   * @param d The display to set up again after a recovery.
+   */
+  Bus(Model &model, Adc &a, Display &d) : m(model), adc(a), disp(d) {}
+
+  /**
+   * @brief Enables the transaction timeout.
+   *
+   * Should be called right after Wire.begin(), so the other modules'
+   * initialization is covered too. The watchdog is enabled on the first
+   * loop, as the display's welcome screen takes longer than its timeout.
+   */
+  void init()
+  {
+    m.resetCause = resetCause;
+    Wire.setWireTimeout(BUS_TIMEOUT_US, true);
+  }
+
+  /**
+   * @brief Recovers the bus if a device timed out.
+   *
+   * @param dev Device that used the bus since the previous check.
+   */
+  void check(BusDevice dev)
+  {
+    if (!Wire.getWireTimeoutFlag())
+      return;
+    Wire.clearWireTimeoutFlag();
+    m.busErrors[dev]++;
+
+    release();
+    if (dev == BUS_ADC)
+      adc.init();
+    else
+      disp.reinit();
+    m.busRecoveries++;
+    report();
+  }
+
+  /**
+   * @brief Tells the watchdog that the loop is running.
+   *
+   * Should be called once per loop round.
+   */
+  inline void loop()
+  {
+    if (!armed)
+    {
+      wdt_enable(BUS_WATCHDOG);
+      armed = true;
+    }
+    wdt_reset();
+  }
+};
@@ -10,29 +10,58 @@ class Calc
 private:
   Model &m; // Reference to the Model object containing measurement values
 
+public:
   /**
-   * @brief Converts power from dBm to watts.
+   * @brief Constructor for the Calc class.
    *
-   * This function converts a given power value in dBm into its equivalent in watts.
-   * The conversion formula used is: W = 10^(dBm/10) / 1000.
+   * Initializes an instance of Calc with a reference to a Model object.
+   *
+   * @param model Reference to a Model object.
+   */
+  Calc(Model &model) : m(model) {}
+
+  /**
+   * @brief Converts a forward detector voltage to forward power in dBm.
    *
-   * @param dbm Power level in dBm.
-   * @return Corresponding power in watts.
+   * @param fwdV Forward detector voltage in mV.
+   * @return Forward power in dBm.
    */
-  inline double dbm2w(double dbm)
+  inline double fwdPower(double fwdV) const
   {
-    return pow(10, dbm / 10.0 - 3.0);
+    // make frequency correction to the voltage reading
+    fwdV -= -0.6282E-3 * static_cast<double>(m.freq) + 8.9;
+
+    // detector slope and intercept, coupler attenuation and the extra 20 dB attenuator
+    return 0.02452 * fwdV - 71.469 + m.coupling() + 20.2;
   }
 
-public:
   /**
-   * @brief Constructor for the Calc class.
+   * @brief Converts a reflected detector voltage to reflected power in dBm.
    *
-   * Initializes an instance of Calc with a reference to a Model object.
+   * @param refV Reflected detector voltage in mV.
+   * @return Reflected power in dBm.
+   */
+  inline double refPower(double refV) const
+  {
+    // make frequency correction to the voltage reading
+    refV -= -0.6473E-3 * static_cast<double>(m.freq) + 8.09;
+
+    // detector slope and intercept, coupler directivity and the extra 20 dB attenuator
+    return 0.024750 * refV - 72.722 + m.directivity() + 20.2;
+  }
+
+  /**
+   * @brief Converts reflected power back to the reflected detector voltage.
    *
-   * @param model Reference to a Model object.
+   * The inverse of refPower(), used to express power limits as ADC codes.
+   *
+   * @param refp Reflected power in dBm.
+   * @return Reflected detector voltage in mV.
    */
-  Calc(Model &model) : m(model) {}
+  inline double refVoltage(double refp) const
+  {
+    return (refp - 20.2 - m.directivity() + 72.722) / 0.024750 + (-0.6473E-3 * static_cast<double>(m.freq) + 8.09);
+  }
 
   /**
    * @brief Placeholder for any initialization logic.
@@ -49,6 +78,12 @@ public:
    * The calculations consider whether the readings are based on an AD8307 logarithmic amplifier
    * or a diode detector. Adjustments for signal presence and probe attenuation are also made.
    *
+   * Powers are calculated for the port of the latest reading, with the
+   * detector drift tracked by the auto-zero removed. The voltages come in
+   * 1/16 mV and are converted with their fraction bits. For the port selected
+   * for display they become the model's current powers, from which the
+   * other metrics are derived on demand.
+   *
    * @note This function should be called after updating the model with the latest readings.
    */
   void loop()
@@ -56,35 +91,16 @@ public:
     if(m.enc_changed)
       return;
 
-    double fwdV = m.fwdV; // Forward voltage reading
-    double refV = m.refV; // Reflected voltage reading
+    // Calculate incident and reflected power of the port just read
+    PortReading &r = m.ports[m.port];
+    r.fwdp = fwdPower((static_cast<int32_t>(r.fwdV) - r.fwdDrift) / static_cast<double>(ADC_SCALE));
+    r.refp = refPower((static_cast<int32_t>(r.refV) - r.refDrift) / static_cast<double>(ADC_SCALE));
 
-    // make frequency corrections to the voltage readings
-    fwdV -= -0.6282E-3 * static_cast<double>(m.freq) + 8.9;
-    refV -= -0.6473E-3 * static_cast<double>(m.freq) + 8.09;
-
-    // Calculate incident 
-    m.fwdp = 0.02452 * fwdV - 71.469;
-    m.refp = 0.024750 * refV - 72.722;
-
-    // coupler attenuations to be added to the power readings
-    m.fwdp += m.coupling();
-    m.refp += m.directivity();
-
-    // extra 20 dB attenuators to be added to the power readings
-    m.fwdp += 20.2;
-    m.refp += 20.2;
-
-    // Convert powers from dBm to watts
-    m.fwdw = dbm2w(m.fwdp);
-    m.refw = dbm2w(m.refp);
-
-    // Calculate reflection coefficient, SWR, and return loss
-    m.gamma = sqrt(m.refw / m.fwdw);       // Reflection coefficient
-    m.swr = (1 + m.gamma) / (1 - m.gamma); // Standing Wave Ratio
-    m.rl = -20 * log10(m.gamma);           // Return Loss in dB
-    // Calculate loss of power in watts
-    // Loss = Forward Power * ((SWR - 1) / (SWR + 1))^2
-    m.loss = m.fwdw * ((m.swr - 1)*(m.swr - 1)) / ((m.swr + 1)*(m.swr + 1));
+    // The rest is shown for the selected port only
+    if (m.port != m.selPort)
+      return;
+    // Powers in watts, reflection coefficient, SWR, return loss and the loss
+    // of power are derived by the model when first read
+    m.setPowers(r.fwdp, r.refp);
   }
 };
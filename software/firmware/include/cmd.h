@@ -0,0 +1,479 @@
+#pragma once
+
+#include <Arduino.h>
+#include "model.h"
+#include "time.h"
+#include "link.h"
+#include "profile.h"
+#include "ram.h"
+
+#define CMD_LINE_LENGTH 24   // Longest accepted command line, terminator included
+#define CMD_BYTES_PER_PASS 8 // Maximum bytes taken from the serial port per loop()
+#define CMD_MAX_DECIMATION 255
+#define CMD_MAX_AVG_WINDOW 256
+#define CMD_MAX_TRIM_MV 1000 // Largest detector offset trim of the I and J commands
+#define STATUS_LINES 6       // Lines of the ? report
+
+/**
+ * @brief Class to receive and execute commands sent by the host over the serial port.
+ *
+ * Commands are single text lines terminated by a newline. The first character
+ * selects the command and an optional decimal argument follows it, e.g. "D10".
+ * Every accepted command is answered with a JSON line {"ok":"<cmd>"}, or
+ * with the requested data for queries, and a rejected one with
+ * {"err":"<cmd>"}, so the answers can be told apart from the measurement
+ * records in the same stream.
+ *
+ * The parser consumes at most CMD_BYTES_PER_PASS bytes per call, so it never
+ * holds up the measurement loop no matter how fast the host sends, and the
+ * status report is sent as several lines, one per call.
+ */
+class Cmd
+{
+private:
+  Model &m; // Reference to the Model object the commands act on
+  Time &t;  // Reference to the Time object synced by the host
+  Print &out; // Serial output, polling the SWR protection while it waits, see tx.h
+
+  char line[CMD_LINE_LENGTH]; // Command line being received
+  uint8_t len = 0;            // Number of characters in line
+  bool overflow = false;      // Current line did not fit into the buffer
+  bool answered = false;      // Command printed its own answer
+  uint8_t statusLine = 0;     // Next line of the status report, 0 when not reporting
+  bool receiving = false;     // First byte of the current line has been stamped
+  uint64_t received = 0;      // Local clock when the first byte of the line arrived
+
+  // Answers an accepted command.
+  void ok(char c)
+  {
+    out.print(F("{\"ok\":\""));
+    out.print(c);
+    out.println(F("\"}"));
+  }
+
+  // Answers a rejected command.
+  void err(char c)
+  {
+    m.cmdErrors++;
+    out.print(F("{\"err\":\""));
+    out.print(c);
+    out.println(F("\"}"));
+  }
+
+  /**
+   * @brief Prints the next line of the status report.
+   *
+   * The report is split into STATUS_LINES short JSON lines printed one per
+   * loop pass, like the band scan dump, so a ? never holds up the loop for
+   * the whole report and each line fits into the serial transmit buffer.
+   */
+  void statusNext()
+  {
+    switch (statusLine++)
+    {
+    case 1:
+      out.print(F("{\"log\":"));
+      out.print(m.logging ? 1 : 0);
+      out.print(F(",\"dec\":"));
+      out.print(m.decimation);
+      out.print(F(",\"avg\":"));
+      out.print(m.avgWindow);
+      out.print(F(",\"em\":"));
+      out.print(static_cast<int>(m.logMode));
+      out.print(F(",\"key\":"));
+      out.print(m.keyed ? 1 : 0);
+      out.print(F(",\"tx\":"));
+      out.print(m.txId);
+      break;
+
+    case 2:
+      out.print(F("{\"scr\":"));
+      out.print(static_cast<int>(m.scr));
+      out.print(F(",\"sig\":"));
+      out.print(m.isSignalPresent() ? 1 : 0);
+      out.print(F(",\"lt\":"));
+      out.print(m.loopTime);
+      out.print(F(",\"idle\":"));
+      out.print(m.idle ? 1 : 0);
+      out.print(F(",\"wl\":"));
+      out.print(m.wakeLatency);
+      break;
+
+    case 3:
+      out.print(F("{\"sync\":"));
+      out.print(m.clockSynced ? 1 : 0);
+      out.print(F(",\"ppb\":"));
+      out.print(m.clockDrift);
+      out.print(F(",\"ce\":"));
+      out.print(m.clockError);
+      out.print(F(",\"trip\":"));
+      out.print(m.tripped ? 1 : 0);
+      break;
+
+    case 4:
+      out.print(F("{\"swr10\":"));
+      out.print(m.tripSwr10);
+      out.print(F(",\"port\":"));
+      out.print(m.selPort);
+      out.print(F(",\"pm\":"));
+      out.print(m.portMask);
+      out.print(F(",\"rps\":"));
+      out.print(m.readingRate);
+      out.print(F(",\"hl\":"));
+      out.print(m.histLen);
+      out.print(F(",\"ram\":"));
+      out.print(freeRam());
+      break;
+
+    case 5:
+      out.print(F("{\"baud\":"));
+      out.print(m.linkBaud);
+      out.print(F(",\"bps\":"));
+      out.print(m.linkRate);
+      out.print(F(",\"lf\":"));
+      out.print(m.linkFails);
+      out.print(F(",\"stall\":"));
+      out.print(m.linkStalls);
+      break;
+
+    default:
+      out.print(F("{\"cerr\":"));
+      out.print(m.cmdErrors);
+      out.print(F(",\"rst\":"));
+      out.print(m.resetCause);
+      out.print(F(",\"bus\":"));
+      out.print(m.busRecoveries);
+      out.print(F(",\"ae\":"));
+      out.print(m.busErrors[BUS_ADC]);
+      out.print(F(",\"de\":"));
+      out.print(m.busErrors[BUS_DISP]);
+      statusLine = 0; // Report done
+      break;
+    }
+    out.println(F("}"));
+  }
+
+  // Reports the corrected current time.
+  void now()
+  {
+    char stamp[25];
+    out.print(F("{\"t\":"));
+    out.print(formatMicros(stamp, m.hostTime(m.micros64())));
+    out.println(F("}"));
+    answered = true;
+  }
+
+  // Reports the noise floors, drifts and latched zeros of the displayed port.
+  void zero()
+  {
+    const PortReading &r = m.ports[m.selPort];
+    out.print(F("{\"zero\":"));
+    out.print(m.zeroEnabled ? 1 : 0);
+    out.print(F(",\"zf\":"));
+    out.print(r.fwdFloor / static_cast<double>(ADC_SCALE));
+    out.print(F(",\"zr\":"));
+    out.print(r.refFloor / static_cast<double>(ADC_SCALE));
+    out.print(F(",\"df\":"));
+    out.print(r.fwdDrift / static_cast<double>(ADC_SCALE));
+    out.print(F(",\"dr\":"));
+    out.print(r.refDrift / static_cast<double>(ADC_SCALE));
+    out.print(F(",\"zl\":"));
+    out.print(r.zeroLatched ? 1 : 0);
+    out.print(F(",\"z0f\":"));
+    out.print(r.fwdZero / static_cast<double>(ADC_SCALE));
+    out.print(F(",\"z0r\":"));
+    out.print(r.refZero / static_cast<double>(ADC_SCALE));
+    out.println(F("}"));
+    answered = true;
+  }
+
+  // Reports the trims and rate divider of the displayed port.
+  void portSetting()
+  {
+    const PortSetting &p = m.portSettings[m.selPort];
+    out.print(F("{\"port\":"));
+    out.print(m.selPort);
+    out.print(F(",\"div\":"));
+    out.print(p.divider);
+    out.print(F(",\"ft\":"));
+    out.print(p.fwdTrim);
+    out.print(F(",\"rt\":"));
+    out.print(p.refTrim);
+    out.println(F("}"));
+    answered = true;
+  }
+
+  /**
+   * @brief Parses an unsigned decimal number of up to 64 bits.
+   *
+   * @param s Text to parse, must consist of digits only.
+   * @param value Parsed value.
+   * @return true if the text was a valid number.
+   */
+  bool parse(const char *s, uint64_t &value)
+  {
+    value = 0;
+    if (*s == '\0')
+      return false;
+    for (; *s != '\0'; s++)
+    {
+      if (!isdigit(*s) || value > (UINT64_MAX - 9) / 10)
+        return false;
+      value = value * 10 + (*s - '0');
+    }
+    return true;
+  }
+
+  /**
+   * @brief Parses and executes the command held in the line buffer.
+   *
+   * @return true if the command was valid and executed.
+   */
+  bool execute()
+  {
+    char c = line[0];
+    bool hasArg = len > 1;
+    bool negative = line[1] == '-' && (c == 'I' || c == 'J'); // Only the trims take a sign
+    uint64_t arg64 = 0;
+
+    if (hasArg && !parse(line + 1 + negative, arg64))
+      return false; // Not a number
+    unsigned long arg = arg64 > UINT32_MAX ? UINT32_MAX : arg64;
+
+    switch (c)
+    {
+    case 'L': // L1 starts and L0 stops logging
+      if (!hasArg || arg > 1)
+        return false;
+      m.logging = arg == 1;
+      return true;
+
+    case 'D': // D<n> logs every n:th measurement
+      if (!hasArg || arg < 1 || arg > CMD_MAX_DECIMATION)
+        return false;
+      m.decimation = arg;
+      return true;
+
+    case 'A': // A<n> averages n ADC samples per reading
+      if (!hasArg || arg < 1 || arg > CMD_MAX_AVG_WINDOW)
+        return false;
+      m.avgWindow = arg;
+      return true;
+
+    case 'S': // S<n> selects the screen
+      if (!hasArg || arg > static_cast<unsigned long>(LAST_SCREEN))
+        return false;
+      m.scr = static_cast<Screen>(arg);
+      return true;
+
+    case 'H': // H<ms> sets the history sampling interval
+      if (!hasArg || arg < 1 || arg > UINT16_MAX)
+        return false;
+      m.histInterval = arg;
+      return true;
+
+    case 'P': // P<n> sets the protection trip SWR times ten
+      if (!hasArg || arg < 11 || arg > UINT8_MAX)
+        return false;
+      m.tripSwr10 = arg;
+      return true;
+
+    case 'R': // R resets the protection trip
+      if (hasArg)
+        return false;
+      m.tripped = false;
+      return true;
+
+    case 'O': // O<n> shows the port n on the display
+      if (!hasArg || arg >= PORT_COUNT || !(m.portMask & (1 << arg)))
+        return false;
+      m.selPort = arg;
+      return true;
+
+    case 'M': // M<mask> reads only the ports whose bits are set
+      if (!hasArg || arg < 1 || arg >= (1 << PORT_COUNT))
+        return false;
+      m.portMask = arg;
+      if (!(m.portMask & (1 << m.selPort)))
+        m.nextPort();
+      return true;
+
+    case 'N': // N reports the displayed port's settings, N<n> reads it on every n:th turn
+      if (!hasArg)
+      {
+        portSetting();
+        return true;
+      }
+      if (arg < 1 || arg > UINT8_MAX)
+        return false;
+      m.portSettings[m.selPort].divider = arg;
+      return true;
+
+    case 'I': // I<mV> sets the forward detector trim of the displayed port
+    case 'J': // J<mV> sets the reflected detector trim of the displayed port
+      if (!hasArg || arg > CMD_MAX_TRIM_MV)
+        return false;
+      if (c == 'I')
+        m.portSettings[m.selPort].fwdTrim = negative ? -static_cast<int16_t>(arg) : arg;
+      else
+        m.portSettings[m.selPort].refTrim = negative ? -static_cast<int16_t>(arg) : arg;
+      return true;
+
+#ifdef PROFILING
+    case 'B': // B prints the profiling report and restarts profiling
+      if (hasArg)
+        return false;
+      m.profileReport = true;
+      return true;
+#endif
+
+    case 'U': // U<baud> switches the serial link to a new rate
+      if (!hasArg || !Link::supported(arg))
+        return false;
+      m.linkRequest = arg;
+      return true;
+
+    case 'K': // K confirms the new rate after U
+      if (hasArg || !m.linkPending)
+        return false;
+      m.linkPending = false;
+      return true;
+
+    case 'F': // F prints the band scan
+      if (hasArg)
+        return false;
+      m.scanDump = true;
+      return true;
+
+    case 'X': // X clears the band scan, X<khz> also sets its bin width
+      if (hasArg && (arg < 1 || arg > 1000))
+        return false;
+      if (hasArg)
+        m.scanBinKhz = arg;
+      m.scanClear = true;
+      return true;
+
+    case 'Z': // Z reports the auto-zero, Z1 turns its correction on and Z0 off
+      if (!hasArg)
+      {
+        zero();
+        return true;
+      }
+      if (arg > 1)
+        return false;
+      m.zeroEnabled = arg == 1;
+      for (uint8_t p = 0; p < PORT_COUNT && !m.zeroEnabled; p++)
+      {
+        m.ports[p].fwdDrift = 0;
+        m.ports[p].refDrift = 0;
+      }
+      return true;
+
+    case 'E': // E<n> logs measurements (0), transmission summaries (1) or both (2)
+      if (!hasArg || arg > LOG_BOTH)
+        return false;
+      m.logMode = static_cast<LogMode>(arg);
+      return true;
+
+    case 'C': // C logs the next measurement
+      if (hasArg)
+        return false;
+      m.capture = true;
+      return true;
+
+    case 'T': // T reports the time, T<us> syncs the clock to the host time
+      if (hasArg)
+        t.sync(arg64, received);
+      else
+        now();
+      return true;
+
+    case '?': // ? reports the status
+      if (hasArg)
+        return false;
+      statusLine = 1; // Printed from the next pass on
+      answered = true;
+      return true;
+    }
+    return false;
+  }
+
+public:
+  /**
+   * @brief Constructor for the Cmd class.
+   *
+   * @param model The model the commands act on.
+   * @param time The time base synced by the host.
+   * @param o Serial output for the answers.
+   */
+  Cmd(Model &model, Time &time, Print &o) : m(model), t(time), out(o) {}
+
+  void init() {}
+
+  /**
+   * @brief Collects command characters from the serial port.
+   *
+   * Reads what is available, at most CMD_BYTES_PER_PASS bytes, into the line
+   * buffer and executes the command once its newline arrives. Lines longer
+   * than the buffer are discarded as a whole. A status report in progress
+   * gets its next line first.
+   */
+  void loop()
+  {
+    if (statusLine != 0)
+      statusNext();
+
+    for (uint8_t n = 0; n < CMD_BYTES_PER_PASS && Serial.available() > 0; n++)
+    {
+      watch();
+      char c = Serial.read();
+      if (c == '\r')
+        continue;
+
+      if (c != '\n')
+      {
+        if (len < CMD_LINE_LENGTH - 1)
+          line[len++] = toupper(c);
+        else
+          overflow = true;
+        continue;
+      }
+
+      if (len > 0)
+      {
+        line[len] = '\0';
+        answered = false;
+        if (!overflow && execute())
+        {
+          if (!answered)
+            ok(line[0]);
+        }
+        else
+          err(line[0]);
+      }
+      len = 0;
+      overflow = false;
+      receiving = false;
+    }
+  }
+
+  /**
+   * @brief Stamps the arrival of the first byte of a command line.
+   *
+   * The bytes behind it in the receive buffer arrived after it, so it was
+   * received at least that many byte times ago at the link rate. Called by
+   * loop() and between the phases of the main loop, so a T command is
+   * stamped within a phase of its arrival and not after the parser passes
+   * that collect the whole line.
+   */
+  void watch()
+  {
+    if (receiving)
+      return;
+    int n = Serial.available();
+    if (n == 0)
+      return;
+    receiving = true;
+    received = m.micros64() - (n - 1) * 10000000UL / m.linkBaud;
+  }
+};
@@ -4,13 +4,18 @@
 #include <ArduinoJson.h>
 #include <math.h>
 #include "model.h"
+#include "time.h"
 
 class DataLogger
 {
 private:
-  static const size_t capacity = JSON_OBJECT_SIZE(4) + 40;
+  static const size_t capacity = JSON_OBJECT_SIZE(5) + 40;
   StaticJsonDocument<capacity> doc;
   Model &m; // Reference to the Model object containing measurement values
+  Print &out; // Serial output, polling the SWR protection while it waits, see tx.h
+  uint8_t skipped = 0; // Measurements dropped since the last logged one
+  char stamp[25];      // Time stamp text of the current record
+  bool tripLogged = false; // Protection trip has been reported
 
 #include <math.h>
 
@@ -29,8 +34,25 @@ private:
     return round(value * 1000.0) / 1000.0;
   }
 
+  /**
+   * @brief Reports a protection trip once as a JSON line.
+   *
+   * The line holds the trip time like the measurement records and the peak
+   * forward and reflected detector codes seen while tripped so far.
+   */
+  void logTrip()
+  {
+    formatMicros(stamp, m.hostTime(m.tripTime));
+    doc[F("trip")] = serialized(static_cast<const char *>(stamp));
+    doc[F("fc")] = m.tripFwd;
+    doc[F("rc")] = m.tripRef;
+    serializeJson(doc, out);
+    out.println();
+    doc.clear();
+  }
+
 public: 
-  DataLogger(Model &model) : m(model) {}
+  DataLogger(Model &model, Print &o) : m(model), out(o) {}
 
   void init() {
   }
@@ -40,22 +62,55 @@ public:
    *
    * The loop function reads the latest measurement data from the model, creates
    * a JSON object with the data, and serializes it to the serial console. The
-   * JSON object contains the timestamp in milliseconds, approximate frequency in kHz,
-   * forward power in dBm, and reflected power in dBm. The power values are
+   * JSON object contains the timestamp in milliseconds with microsecond decimals,
+   * taken when the ADC reading was acquired and corrected to the host clock
+   * once synced, approximate frequency in kHz,
+   * forward power in dBm, and reflected power in dBm of the port just read,
+   * with the port number when there are several ports. The power values are
    * rounded to three decimal places before being added to the JSON object.
    * A newline is printed after the JSON object to delimit each measurement.
    * The JSON document is cleared after each measurement to prepare it for the
    * next loop iteration.
+   *
+   * Only every m.decimation:th measurement is logged, and nothing is logged
+   * while m.logging is off or only the transmission summaries are logged,
+   * unless a capture has been requested. A protection trip is always
+   * reported.
+   *
+   * The bytes logged are counted for the link throughput, and a record that
+   * does not fit into the serial transmit buffer is counted as a stall.
    */
   void loop() {
+    if (m.tripped != tripLogged)
+    {
+      tripLogged = m.tripped;
+      if (tripLogged)
+        logTrip();
+    }
     if (m.enc_changed)
       return;
-    doc[F("t")] = millis(); // Timestamp in milliseconds
+    if (!m.capture)
+    {
+      if (!m.logging || m.logMode == LOG_SUMMARIES || ++skipped < m.decimation)
+        return;
+    }
+    skipped = 0;
+    m.capture = false;
+    formatMicros(stamp, m.hostTime(m.sampleTime));
+    doc[F("t")] = serialized(static_cast<const char *>(stamp)); // Acquisition time in milliseconds
     doc[F("f")] = m.freq;   // Frequency in kHz
-    doc[F("i")] = roundToThreeDecimalPlaces(m.fwdp); // Forward power in dBm, rounded to three decimal places 
-    doc[F("r")] = roundToThreeDecimalPlaces(m.refp); // Reflected power in dBm, rounded to three decimal places 
-    serializeJson(doc, Serial);
-    Serial.println(); // Print a newline after the JSON object
+    const PortReading &r = m.ports[m.port];
+#if PORT_COUNT > 1
+    doc[F("p")] = m.port;   // Coupler port of the reading
+#endif
+    doc[F("i")] = roundToThreeDecimalPlaces(r.fwdp); // Forward power in dBm, rounded to three decimal places 
+    doc[F("r")] = roundToThreeDecimalPlaces(r.refp); // Reflected power in dBm, rounded to three decimal places 
+    size_t size = measureJson(doc) + 2;
+    if (Serial.availableForWrite() < static_cast<int>(size))
+      m.linkStalls++; // The record will block until the buffer has room
+    serializeJson(doc, out);
+    out.println(); // Print a newline after the JSON object
+    m.linkBytes += size;
     doc.clear(); // Clear the document for the next loop iteration
   }
 };
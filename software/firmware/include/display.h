@@ -4,17 +4,111 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include "model.h"
+#include "adc.h"
+#include "cmd.h"
+#include "fmt.h"
 
 #define SCREEN_WIDTH 128    // OLED display width, in pixels
 #define SCREEN_HEIGHT 32    // OLED display height, in pixels
 #define OLED_RESET -1       // Reset pin # (or -1 if sharing Arduino reset pin)
 #define SCREEN_ADDRESS 0x3C // Screen I2C address for 128x32 display
+#define TREND_HEIGHT 16     // Height of each trend graph, in pixels
+#define SCAN_TOP 8          // First row of the band scan graph, below the text row
+#define SCAN_SWR_RANGE 200  // SWR above 1 shown at the full graph height, times 100
+#define DISPLAY_CHUNK 31    // Display data bytes per I2C transaction, Wire's buffer less the control byte
+
+static_assert(HISTORY_LEN <= SCREEN_WIDTH, "trend history does not fit on the display");
 
 class Display
 {
 private:
-  const Model &m;     // Reference to the Model object containing measurement data
-  Adafruit_SSD1306 d; // SSD1306 display object
+  const Model &m;          // Reference to the Model object containing measurement data
+  Adc &adc;                // ADC polled for the SWR protection while drawing
+  Cmd &cmd;                // Commands stamped on arrival while drawing
+  Adafruit_SSD1306 d;      // SSD1306 display object
+  bool blanked = false;    // Display switched off for the idle mode
+  Screen shown = MAIN;     // Screen drawn on the previous loop
+  uint16_t trendCount = 0; // History samples drawn on the trend screen
+  uint16_t scanUpdates = 0; // Band scan updates drawn on the scan screen
+  Line line;               // Text of the row being drawn
+
+  /**
+   * @brief Polls the ADC for the SWR protection and stamps a command arriving.
+   *
+   * Called between the text rows and panel pages, each of which takes a few
+   * milliseconds.
+   */
+  void poll()
+  {
+    adc.poll();
+    cmd.watch();
+  }
+
+  /**
+   * @brief Prints the text row in line and polls the ADC for the protection.
+   *
+   * Drawing a row of text takes a few milliseconds, so the SWR protection
+   * gets a sample pair after each one.
+   */
+  void row()
+  {
+    d.println(line.c_str());
+    poll();
+  }
+
+  /**
+   * @brief Sets the panel's column and page address window for the data sent next.
+   */
+  void window(uint8_t x0, uint8_t x1, uint8_t page0, uint8_t page1)
+  {
+    Wire.beginTransmission(SCREEN_ADDRESS);
+    Wire.write(0x00); // Co = 0, D/C = 0: the rest are commands
+    Wire.write(SSD1306_COLUMNADDR);
+    Wire.write(x0);
+    Wire.write(x1);
+    Wire.write(SSD1306_PAGEADDR);
+    Wire.write(page0);
+    Wire.write(page1);
+    Wire.endTransmission();
+  }
+
+  /**
+   * @brief Sends display data to the current address window.
+   *
+   * @param buf Bytes to send, one 8 pixel column segment each.
+   * @param n Number of bytes.
+   */
+  void data(const uint8_t *buf, uint16_t n)
+  {
+    while (n > 0)
+    {
+      uint8_t chunk = n < DISPLAY_CHUNK ? n : DISPLAY_CHUNK;
+      Wire.beginTransmission(SCREEN_ADDRESS);
+      Wire.write(0x40); // Co = 0, D/C = 1: the rest is display data
+      Wire.write(buf, chunk);
+      Wire.endTransmission();
+      buf += chunk;
+      n -= chunk;
+    }
+  }
+
+  /**
+   * @brief Sends the display buffer to the panel one page at a time.
+   *
+   * Used instead of Adafruit_SSD1306::display(), which sends the whole
+   * buffer in one go, so that the SWR protection gets a sample pair after
+   * each 8 pixel high page.
+   */
+  void show()
+  {
+    const uint8_t *buf = d.getBuffer();
+    for (uint8_t page = 0; page < SCREEN_HEIGHT / 8; page++)
+    {
+      window(0, SCREEN_WIDTH - 1, page, page);
+      data(buf + page * SCREEN_WIDTH, SCREEN_WIDTH);
+      poll();
+    }
+  }
 
   /**
    * @brief Displays a welcome message on the screen.
@@ -27,7 +121,7 @@ private:
     d.clearDisplay();
     d.setCursor(0, 10);
     d.println(F("SWR METER OH8KVA"));
-    d.display();
+    show();
   }
 
   /**
@@ -40,35 +134,36 @@ private:
     d.setCursor(0, 0);
 
     // row 0: Forward Power
-    d.print(F("FWD __: "));
-    printPower(m.fwdw);
-    d.print(" ");
+#if PORT_COUNT > 1
+    line.clear().text(F("FWD P")).number(m.selPort).text(F(": ")).power(m.fwdw()).chr(' ');
+#else
+    line.clear().text(F("FWD __: ")).power(m.fwdw()).chr(' ');
+#endif
     if (m.isSignalPresent())
-      d.print(F("S"));
-    d.println();
+      line.chr('S');
+    if (m.tripped)
+      line.chr('T');
+    row();
 
     // row 1: SWR
-    d.print(F("SWR __: "));
-    if (m.swr > 0)
-      printFixedWidth(m.swr, 5, 1);
-    d.println();
+    line.clear().text(F("SWR __: "));
+    if (m.swr() > 0)
+      line.fixed(m.swr(), 5, 1);
+    row();
 
     // row 2: Return Loss
-    d.print(F("RL ___: "));
-    if (m.rl > 0)
-    {
-      printFixedWidth(m.rl, 4, 2);
-      d.print(F(" dB"));
-    }
-    d.println();
+    line.clear().text(F("RL ___: "));
+    if (m.rl() > 0)
+      line.fixed(m.rl(), 4, 2).text(F(" dB"));
+    row();
 
     // row 3: Loss of Power
-    d.print(F("LOSS _: "));
-    if (m.loss > 0)
-      printPower(m.loss);
-    d.println();
+    line.clear().text(F("LOSS _: "));
+    if (m.loss() > 0)
+      line.power(m.loss());
+    row();
 
-    d.display();
+    show();
   }
 
   /**
@@ -79,8 +174,12 @@ private:
     d.clearDisplay();
     d.setCursor(0, 0);
     d.println(F("Documents at github"));
-    d.println(F("https://github.com/oh9vd/powermeter"));
-    d.display();
+    poll();
+    d.print(F("https://github.com/")); // Wrapped by the display, drawn in two parts
+    poll();
+    d.println(F("oh9vd/powermeter"));
+    poll();
+    show();
   }
 
   /**
@@ -94,28 +193,22 @@ private:
     d.setCursor(0, 0);
 
     // row 0: Forward dBm
-    d.print(F("forward: "));
-    d.print(m.fwdp, 1);
-    d.print(F(" dBm "));
-    d.println();
+    line.clear().text(F("forward: ")).decimal(m.fwdp, 1).text(F(" dBm "));
+    row();
 
     // row 1: Reflected dBm
-    d.print(F("reflected: "));
-    d.print(m.refp, 1);
-    d.print(F(" dBm "));
-    d.println();
+    line.clear().text(F("reflected: ")).decimal(m.refp, 1).text(F(" dBm "));
+    row();
 
     // row 2: Forward Watts
-    d.print(F("forward: "));
-    printPower(m.fwdw);
-    d.println();
+    line.clear().text(F("forward: ")).power(m.fwdw());
+    row();
 
     // row 3: Reflected Watts
-    d.print(F("reflected: "));
-    printPower(m.refw);
-    d.println();
+    line.clear().text(F("reflected: ")).power(m.refw());
+    row();
 
-    d.display();
+    show();
   }
 
   /**
@@ -128,127 +221,181 @@ private:
     d.setCursor(0, 0);
 
     // Row 0: Frequency and Time
-    d.print(F("f: "));
-    d.print(m.freq);
-    d.print(F(" t: "));
-    d.print(m.loopTime);
-    d.println();
+    line.clear().text(F("f: ")).number(m.freq).text(F(" t: ")).number(m.loopTime);
+    row();
 
     // Row 1: Forward and Reflected Voltage
-    d.print(F("fw: "));
-    d.print(m.fwdV);
-    d.print(F(" rw: "));
-    d.print(m.refV);
-    d.println();
-
-    d.print(F("cpl: "));
-    double cpl = m.coupling();
-    d.print(cpl, 1);
-    d.print(F(" dir: "));
-    double dir = m.directivity();
-    d.print(dir);
-    d.println();
+    line.clear().text(F("fw: ")).decimal(m.fwdV / static_cast<double>(ADC_SCALE), 1);
+    line.text(F(" rw: ")).decimal(m.refV / static_cast<double>(ADC_SCALE), 1);
+    row();
+
+    // Row 2: Coupling and Directivity
+    line.clear().text(F("cpl: ")).decimal(m.coupling(), 1);
+    line.text(F(" dir: ")).decimal(m.directivity());
+    row();
 
     // Row 3: RSSI Value
-    d.print(F("rs: "));
-    d.print(m.rssiV);
-    d.println();
+    line.clear().text(F("rs: ")).number(m.rssiV);
+    row();
+
+    show();
+  }
+
+  /**
+   * @brief Draws one history sample as a display column.
+   *
+   * The forward power is drawn as a bar growing up from the middle of the
+   * screen, about 4 dB per pixel, and the SWR as a bar growing up from the
+   * bottom, longer for worse SWR, about 2 dB of return loss per pixel.
+   *
+   * @param x Column and history slot to draw.
+   */
+  void trendColumn(uint8_t x)
+  {
+    d.drawFastVLine(x, 0, SCREEN_HEIGHT, SSD1306_BLACK);
+
+    uint8_t fwd = m.histFwd[x];
+    if (fwd == 0)
+      return; // No signal
+
+    uint8_t h = fwd / 16 + 1;
+    d.drawFastVLine(x, TREND_HEIGHT - h, h, SSD1306_WHITE);
 
-    d.display();
+    uint8_t rl = m.histRl[x] / 8;
+    h = TREND_HEIGHT - (rl < TREND_HEIGHT - 1 ? rl : TREND_HEIGHT - 1);
+    d.drawFastVLine(x, SCREEN_HEIGHT - h, h, SSD1306_WHITE);
   }
 
   /**
-   * @brief Prints a power value in a readable format with appropriate units.
+   * @brief Sends one column of the display buffer to the panel.
    *
-   * @param powW The power value in Watts.
-   * @param width Optional, the width of printed string. Default is 5.
+   * Sets the panel's column and page address window to the single column
+   * and writes its bytes, instead of transferring the whole buffer.
+   *
+   * @param x Column to send.
+   */
+  void pushColumn(uint8_t x)
+  {
+    const uint8_t *buf = d.getBuffer();
+    uint8_t column[SCREEN_HEIGHT / 8];
+    for (uint8_t page = 0; page < SCREEN_HEIGHT / 8; page++)
+      column[page] = buf[x + page * SCREEN_WIDTH];
+
+    window(x, x, 0, SCREEN_HEIGHT / 8 - 1);
+    data(column, sizeof(column));
+  }
+
+  /**
+   * @brief Displays the forward power and SWR history.
+   *
+   * The history sweeps across the screen with a blank column after the
+   * newest sample. The whole screen is drawn when the screen is entered or
+   * several samples have arrived, otherwise only the new sample's column
+   * and the blank column after it are drawn and sent to the panel.
    */
-  void printPower(double powW, byte width = 5)
+  void trend()
   {
-    if (powW < 1E-12)
+    uint16_t fresh = m.histCount - trendCount;
+    if (shown == Screen::TREND && fresh == 0)
       return;
+    trendCount = m.histCount;
 
-    else if (powW < 1E-9)
-    {
-      printFixedWidth(powW * 1E12, width, 1);
-      d.print(F(" pW"));
-    }
-    else if (powW < 1E-6)
-    {
-      printFixedWidth(powW * 1E9, width, 1);
-      d.print(F(" nW"));
-    }
-    else if (powW < 1E-3)
+    if (m.histLen == 0)
     {
-      printFixedWidth(powW * 1E6, width, 1);
-      d.print(F(" uW"));
-    }
-    else if (powW < 1)
-    {
-      printFixedWidth(powW * 1E3, width, 1);
-      d.print(F(" mW"));
-    }
-    else if (powW < 1.6E3)
-    {
-      printFixedWidth(powW, width, 1);
-      d.print(F(" W"));
+      d.clearDisplay();
+      d.setCursor(0, 0);
+      d.print(F("TREND: no memory"));
+      show();
+      return;
     }
-    else
+
+    uint8_t gap = m.histHead;
+    uint8_t newest = (gap + m.histLen - 1) % m.histLen;
+
+    if (shown != Screen::TREND || fresh > 1)
     {
-      printFixedWidth(powW / 1E3, width, 2);
-      d.print(F(" kW"));
+      d.clearDisplay();
+      for (uint8_t x = 0; x < m.histLen; x++)
+      {
+        if (x != gap)
+          trendColumn(x);
+      }
+      show();
+      return;
     }
+
+    trendColumn(newest);
+    d.drawFastVLine(gap, 0, SCREEN_HEIGHT, SSD1306_BLACK);
+    pushColumn(newest);
+    pushColumn(gap);
   }
 
   /**
-   * @brief Prints a double with fixed width and precision.
-   *
-   * Pads the number with spaces to match the specified width and prints it
-   * with the specified number of digits after the decimal point.
+   * @brief Displays the band scan as an SWR against frequency curve.
    *
-   * @param number Number to print.
-   * @param width Total width of the printed number.
-   * @param precision Digits to show after decimal.
-   * @param filler Character used for padding. Default is a space.
+   * The text row shows the lowest SWR seen and its frequency. Below it each
+   * bin is a bar of its lowest SWR, placed by frequency between the lowest
+   * and highest bin, with a dot at its mean SWR. Redrawn only when the band
+   * scan has changed.
    */
-  void printFixedWidth(double number, byte width, byte precision = 2, char filler = ' ')
+  void scan()
   {
-    unsigned long integerPart = static_cast<unsigned long>(number);
-    double fractionalPart = number - integerPart;
-    byte digitsPrinted = 0;
+    if (shown == Screen::SCAN && scanUpdates == m.scanUpdates)
+      return;
+    scanUpdates = m.scanUpdates;
 
-    // Calculate integer space
-    unsigned long temp = integerPart;
-    while (temp > 0)
+    d.clearDisplay();
+    d.setCursor(0, 0);
+    if (m.scanUsed == 0)
     {
-      temp /= 10;
-      digitsPrinted++;
+      d.print(F("SCAN: no data"));
+      show();
+      return;
     }
 
-    // Account for fractional part
-    if (precision > 0)
-      digitsPrinted += precision + 1;
-
-    // Print fillers
-    while (digitsPrinted < width)
+    uint16_t lo = UINT16_MAX;
+    uint16_t hi = 0;
+    uint8_t best = 0;
+    for (uint8_t i = 0; i < SCAN_BINS; i++)
     {
-      d.print(filler);
-      digitsPrinted++;
+      const ScanBin &b = m.scan[i];
+      if (b.key == SCAN_EMPTY)
+        continue;
+      if (b.key < lo)
+        lo = b.key;
+      if (b.key > hi)
+        hi = b.key;
+      if (m.scan[best].key == SCAN_EMPTY || b.minSwr < m.scan[best].minSwr)
+        best = i;
     }
 
-    // Print integer and fractional parts
-    d.print(integerPart);
-    if (precision > 0)
+    line.clear().text(F("MIN ")).fixed(static_cast<uint32_t>(m.scan[best].minSwr), 4, 2);
+    line.text(F(" @ ")).number(static_cast<uint32_t>(m.scan[best].key) * m.scanBinKhz).text(F(" kHz"));
+    d.print(line.c_str());
+    poll();
+
+    constexpr uint8_t height = SCREEN_HEIGHT - SCAN_TOP;
+    for (uint8_t i = 0; i < SCAN_BINS; i++)
     {
-      d.print('.');
-      for (byte i = 0; i < precision; i++)
-      {
-        fractionalPart *= 10;
-        byte digit = static_cast<byte>(fractionalPart);
-        d.print(digit);
-        fractionalPart -= digit;
-      }
+      const ScanBin &b = m.scan[i];
+      if (b.key == SCAN_EMPTY)
+        continue;
+
+      uint8_t x = hi == lo ? SCREEN_WIDTH / 2 : static_cast<uint32_t>(b.key - lo) * (SCREEN_WIDTH - 1) / (hi - lo);
+      uint8_t h = swrHeight(b.minSwr, height);
+      d.drawFastVLine(x, SCREEN_HEIGHT - h, h, SSD1306_WHITE);
+      d.drawPixel(x, SCREEN_HEIGHT - swrHeight(b.meanSwr(), height), SSD1306_WHITE);
     }
+    show();
+  }
+
+  // Scales an SWR times 100 to a bar height, at least one pixel.
+  static uint8_t swrHeight(uint16_t swr100, uint8_t height)
+  {
+    uint16_t above = swr100 > 100 ? swr100 - 100 : 0;
+    if (above >= SCAN_SWR_RANGE)
+      return height;
+    return 1 + static_cast<uint32_t>(above) * (height - 1) / SCAN_SWR_RANGE;
   }
 
 public:
@@ -256,11 +403,14 @@ public:
    * @brief Constructs a Display object with the Model reference.
    *
    * Sets up the display dimensions and initializes the display interface.
+   * The library keeps the bus at I2C_CLOCK_HZ after its own transfers.
    *
    * @param model Reference to a Model object.
+   * @param a ADC polled for the SWR protection while drawing.
+   * @param c Commands stamped on arrival while drawing.
    */
-  Display(const Model &model)
-      : m(model), d(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET) {}
+  Display(const Model &model, Adc &a, Cmd &c)
+      : m(model), adc(a), cmd(c), d(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET, I2C_CLOCK_HZ, I2C_CLOCK_HZ) {}
 
   /**
    * @brief Initializes the display setup for SSD1306 OLED.
@@ -284,14 +434,37 @@ public:
     delay(2000);
   }
 
+  /**
+   * @brief Initializes the panel again after an I2C bus recovery.
+   *
+   * Sends the SSD1306 setup without resetting the bus and has the next
+   * loop redraw the current screen and restore the idle blanking.
+   */
+  void reinit()
+  {
+    d.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS, false, false);
+    blanked = false;
+    trendCount = m.histCount - 2;
+    scanUpdates = m.scanUpdates - 1;
+  }
+
   /**
    * @brief Updates the display based on selected screen type.
    *
-   * Determines which screen (main, info, dBm, or raw) to display based on
-   * current selection stored in the model.
+   * Determines which screen (main, info, dBm, raw, trend or scan) to display based on
+   * current selection stored in the model. In the idle mode the panel is
+   * switched off and not redrawn.
    */
   void loop()
   {
+    if (m.idle != blanked)
+    {
+      blanked = m.idle;
+      d.ssd1306_command(blanked ? SSD1306_DISPLAYOFF : SSD1306_DISPLAYON);
+    }
+    if (blanked)
+      return;
+
     switch (m.scr)
     {
     case Screen::MAIN:
@@ -306,6 +479,13 @@ public:
     case Screen::RAW:
       raw();
       break;
+    case Screen::TREND:
+      trend();
+      break;
+    case Screen::SCAN:
+      scan();
+      break;
     }
+    shown = m.scr;
   }
 };
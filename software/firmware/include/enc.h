@@ -43,7 +43,7 @@ public:
     int32_t enc = e.read() >> 2;
 
     // Check if encoder position changed and is within valid range
-    if (enc != m.enc && enc >= static_cast<int>(Screen::MAIN) && enc <= static_cast<int>(Screen::RAW))
+    if (enc != m.enc && enc >= static_cast<int>(Screen::MAIN) && enc <= static_cast<int>(LAST_SCREEN))
     {
       // Update model encoder value and associated screen enumeration
       m.enc = enc;
@@ -63,6 +63,13 @@ public:
     {
       // Update model button state
       m.but = but;
+
+#if PORT_COUNT > 1
+      // A press with a carrier selects the next coupler port for display,
+      // without one it clears the readings and the protection trip
+      if (but && m.isSignalPresent())
+        m.nextPort();
+#endif
     }
   }
 };
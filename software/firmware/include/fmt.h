@@ -0,0 +1,288 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#define LINE_LENGTH 31 // Longest text line; the display wraps it after 21 characters
+
+// Powers of ten used to split numbers into digits without division.
+const uint32_t fmtPow10[] PROGMEM = {
+    1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL,
+    10000UL, 1000UL, 100UL, 10UL, 1UL};
+
+// Unit texts for Line::power().
+const char fmtPW[] PROGMEM = " pW";
+const char fmtNW[] PROGMEM = " nW";
+const char fmtUW[] PROGMEM = " uW";
+const char fmtMW[] PROGMEM = " mW";
+const char fmtW[] PROGMEM = " W";
+const char fmtKW[] PROGMEM = " kW";
+const char *const fmtPowerUnits[] PROGMEM = {fmtPW, fmtNW, fmtUW, fmtMW, fmtW, fmtKW};
+
+/**
+ * @brief Class to format one line of text for the display.
+ *
+ * Integer digits are taken with a table of powers of ten instead of
+ * division. Fractional digits are taken with the same floating point steps
+ * as Print and the display code before, so the text is the same to the last
+ * digit. The finished line is sent to the display with a single print call.
+ * Text past LINE_LENGTH characters is dropped.
+ */
+class Line
+{
+private:
+  char buf[LINE_LENGTH + 1]; // Line text, always terminated
+  uint8_t len = 0;           // Number of characters in buf
+
+  /**
+   * @brief Writes the decimal digits of a number.
+   *
+   * @param v Number to convert.
+   * @param out Buffer of at least 10 characters, not terminated.
+   * @param minDigits Digits to write at least, zero padded.
+   * @return Number of digits written.
+   */
+  static uint8_t digits(uint32_t v, char *out, uint8_t minDigits)
+  {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < 10; i++)
+    {
+      uint32_t p = pgm_read_dword(&fmtPow10[i]);
+      char digit = '0';
+      while (v >= p)
+      {
+        v -= p;
+        digit++;
+      }
+      if (n > 0 || digit != '0' || 10 - i <= minDigits)
+        out[n++] = digit;
+    }
+    return n;
+  }
+
+  // Appends characters, dropping what does not fit.
+  void append(const char *s, uint8_t n)
+  {
+    while (n-- > 0 && len < LINE_LENGTH)
+      buf[len++] = *s++;
+    buf[len] = '\0';
+  }
+
+  /**
+   * @brief Writes fraction digits, truncated a digit at a time.
+   *
+   * @param fraction Fraction from 0 to below 1.
+   * @param out Buffer of at least precision characters, not terminated.
+   * @param precision Number of digits.
+   */
+  static void fractionDigits(double fraction, char *out, uint8_t precision)
+  {
+    for (uint8_t i = 0; i < precision; i++)
+    {
+      fraction *= 10;
+      uint8_t digit = static_cast<uint8_t>(fraction);
+      out[i] = '0' + digit;
+      fraction -= digit;
+    }
+  }
+
+  /**
+   * @brief Appends a number split into parts with fixed width.
+   *
+   * Pads the number with the filler to match the width, like the display
+   * always has: an integer part of zero takes no width, although a 0 is
+   * printed for it.
+   */
+  void padded(const char *intDigits, uint8_t intLen, bool intZero, const char *fracDigits,
+              uint8_t width, uint8_t precision, char filler)
+  {
+    uint8_t used = intZero ? 0 : intLen;
+    if (precision > 0)
+      used += precision + 1;
+    while (used++ < width)
+      append(&filler, 1);
+
+    append(intDigits, intLen);
+    if (precision > 0)
+    {
+      chr('.');
+      append(fracDigits, precision);
+    }
+  }
+
+public:
+  Line() { buf[0] = '\0'; }
+
+  // Empties the line.
+  Line &clear()
+  {
+    len = 0;
+    buf[0] = '\0';
+    return *this;
+  }
+
+  // Returns the line text.
+  const char *c_str() const
+  {
+    return buf;
+  }
+
+  // Appends a character.
+  Line &chr(char c)
+  {
+    append(&c, 1);
+    return *this;
+  }
+
+  // Appends a text from flash.
+  Line &text(const __FlashStringHelper *s)
+  {
+    const char *p = reinterpret_cast<const char *>(s);
+    char c;
+    while ((c = pgm_read_byte(p++)) != '\0')
+      append(&c, 1);
+    return *this;
+  }
+
+  // Appends an unsigned number.
+  Line &number(uint32_t v)
+  {
+    char out[10];
+    append(out, digits(v, out, 1));
+    return *this;
+  }
+
+  /**
+   * @brief Appends a scaled number with fixed width and precision.
+   *
+   * @param scaled Number times 10^precision, truncated.
+   * @param width Total width of the number.
+   * @param precision Digits after the decimal point.
+   * @param filler Character used for padding.
+   */
+  Line &fixed(uint32_t scaled, uint8_t width, uint8_t precision, char filler = ' ')
+  {
+    char out[10];
+    uint8_t n = digits(scaled, out, precision + 1);
+    uint8_t intDigits = n - precision;
+    padded(out, intDigits, intDigits == 1 && out[0] == '0', out + intDigits, width, precision, filler);
+    return *this;
+  }
+
+  /**
+   * @brief Appends a non-negative number with fixed width and precision.
+   *
+   * The digits are truncated, like the display always has.
+   *
+   * @param value Number to append.
+   * @param width Total width of the number.
+   * @param precision Digits after the decimal point, at most 4.
+   * @param filler Character used for padding.
+   */
+  Line &fixed(double value, uint8_t width, uint8_t precision, char filler = ' ')
+  {
+    if (!(value > 0.0)) // Also catches NaN
+      value = 0.0;
+    if (value > 4294967295.0)
+      value = 4294967295.0;
+    uint32_t intPart = static_cast<uint32_t>(value);
+
+    char out[10];
+    char fraction[4];
+    fractionDigits(value - intPart, fraction, precision);
+    padded(out, digits(intPart, out, 1), intPart == 0, fraction, width, precision, filler);
+    return *this;
+  }
+
+  /**
+   * @brief Appends a number rounded to the precision.
+   *
+   * Gives the same text as Print::print(double, precision).
+   *
+   * @param value Number to append.
+   * @param precision Digits after the decimal point, at most 4.
+   */
+  Line &decimal(double value, uint8_t precision = 2)
+  {
+    if (isnan(value))
+      return text(F("nan"));
+    if (isinf(value))
+      return text(F("inf"));
+    if (value > 4294967040.0 || value < -4294967040.0)
+      return text(F("ovf"));
+
+    if (value < 0.0)
+    {
+      chr('-');
+      value = -value;
+    }
+
+    // Round with the same steps as Print, then split into digits
+    double rounding = 0.5;
+    for (uint8_t i = 0; i < precision; i++)
+      rounding /= 10.0;
+    value += rounding;
+    uint32_t intPart = static_cast<uint32_t>(value);
+
+    number(intPart);
+    if (precision > 0)
+    {
+      char out[4];
+      fractionDigits(value - intPart, out, precision);
+      chr('.');
+      append(out, precision);
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Appends a power in Watts with an SI prefix.
+   *
+   * The prefix is chosen and the power scaled with the same steps as the
+   * display code before. Nothing is appended below 1 pW.
+   *
+   * @param watts Power in Watts.
+   * @param width Width of the number.
+   */
+  Line &power(double watts, uint8_t width = 5)
+  {
+    if (!(watts >= 1E-12)) // Also catches NaN
+      return *this;
+
+    uint8_t unit;
+    double value;
+    if (watts < 1E-9)
+    {
+      unit = 0;
+      value = watts * 1E12;
+    }
+    else if (watts < 1E-6)
+    {
+      unit = 1;
+      value = watts * 1E9;
+    }
+    else if (watts < 1E-3)
+    {
+      unit = 2;
+      value = watts * 1E6;
+    }
+    else if (watts < 1)
+    {
+      unit = 3;
+      value = watts * 1E3;
+    }
+    else if (watts < 1.6E3)
+    {
+      unit = 4;
+      value = watts;
+    }
+    else
+    {
+      unit = 5;
+      value = watts / 1E3;
+    }
+
+    fixed(value, width, unit == 5 ? 2 : 1);
+    return text(reinterpret_cast<const __FlashStringHelper *>(pgm_read_ptr(&fmtPowerUnits[unit])));
+  }
+};
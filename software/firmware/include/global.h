@@ -1,2 +1,51 @@
+#pragma once
 
-#define AWG_WINDOW 16
\ No newline at end of file
+#define AWG_WINDOW 16
+
+// Fraction bits of the detector voltages, which are kept in 1/16 mV from the
+// ADC sums to Calc. Averaging n samples gains log2(n) / 2 bits, so 4 bits
+// hold all the resolution of the largest window, CMD_MAX_AVG_WINDOW.
+#define ADC_FRAC_BITS 4
+#define ADC_SCALE (1 << ADC_FRAC_BITS)
+
+// Longest trend history, one sample per display column. The two history rings
+// are allocated at start-up from the SRAM left after the display buffer, less
+// HISTORY_RAM_RESERVE for the stack, so a build with less free memory gets a
+// shorter trend instead of a stack overflow, see history.h.
+#define HISTORY_LEN 128
+// SRAM kept free for the stack and later allocations when sizing the history,
+// in bytes.
+#define HISTORY_RAM_RESERVE 320
+#define HISTORY_INTERVAL_MS 1000
+
+// Default SWR that trips the protection, times ten.
+#define PROTECT_SWR10 30
+
+// I2C bus clock. The LTC2309 and the SSD1306 both run in fast mode, which keeps
+// the display's page transfers short enough for the SWR protection.
+#define I2C_CLOCK_HZ 400000UL
+
+// Number of coupler ports read round-robin, 1 to 4. Each port takes two ADC
+// channels, see portConfigs in adc.h. Can be set from the build flags.
+#ifndef PORT_COUNT
+#define PORT_COUNT 1
+#endif
+
+// Serial link rate after reset and after a failed rate handshake, see link.h.
+#define LINK_DEFAULT_BAUD 57600UL
+
+// Frequency bins of the band scan and their default width. Thirteen bytes each
+// are kept in SRAM, so shrink it if memory runs short.
+#define SCAN_BINS 24
+#define SCAN_BIN_KHZ 10
+#define SCAN_MEAN_WINDOW 32 // Readings after which the means turn into moving averages
+
+// Detector outputs in mV with no signal, where the noise floor tracking of
+// zero.h starts from.
+#define ZERO_FWD_NOMINAL 250
+#define ZERO_REF_NOMINAL 250
+// Readings less than this above the noise floor are clamped to zero, in mV,
+// with the auto-zero on.
+#define ZERO_MARGIN 40
+// Readings below this are clamped to zero, in mV, with the auto-zero off.
+#define ZERO_FIXED_CLAMP 400
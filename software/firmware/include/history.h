@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+#include "global.h"
+#include "model.h"
+#include "ram.h"
+
+/**
+ * @brief Class to record the forward power and SWR history for the trend screen.
+ *
+ * Every m.histInterval milliseconds one sample is written into the ring
+ * buffers in the model. The rings are allocated once at start-up, up to
+ * HISTORY_LEN samples long as far as the free SRAM allows. The values are quantized to one byte each: the
+ * forward power in 0.25 dB steps from 0 dBm, 0 meaning no signal, and the
+ * SWR as return loss in 0.25 dB steps.
+ */
+class History
+{
+private:
+  Model &m; // Reference to the Model object holding the ring buffers
+
+  unsigned long last = 0; // millis() of the last sample
+
+  // Quantizes a dB value to 0.25 dB steps, limited to one byte.
+  inline uint8_t quantize(double db, uint8_t lowest)
+  {
+    double q = db * 4.0;
+    if (q < lowest)
+      return lowest;
+    if (q > 255.0)
+      return 255;
+    return static_cast<uint8_t>(q);
+  }
+
+public:
+  /**
+   * @brief Constructor for the History class.
+   *
+   * @param model The model holding the ring buffers.
+   */
+  History(Model &model) : m(model) {}
+
+  /**
+   * @brief Allocates and clears the ring buffers.
+   *
+   * Takes two bytes per sample from the SRAM left above HISTORY_RAM_RESERVE,
+   * so it must be called after the display has allocated its buffer. With
+   * less than two samples' worth the history is left off.
+   */
+  void init()
+  {
+    uint16_t free = freeRam();
+    uint16_t len = free > HISTORY_RAM_RESERVE ? (free - HISTORY_RAM_RESERVE) / 2 : 0;
+    if (len > HISTORY_LEN)
+      len = HISTORY_LEN;
+
+    uint8_t *rings = len >= 2 ? static_cast<uint8_t *>(calloc(len, 2)) : nullptr;
+    if (rings)
+    {
+      m.histFwd = rings;
+      m.histRl = rings + len;
+      m.histLen = len;
+    }
+    last = millis();
+  }
+
+  /**
+   * @brief Takes a history sample when the interval has elapsed.
+   *
+   * Should be called after the measurement has been calculated.
+   */
+  void loop()
+  {
+    unsigned long now = millis();
+    if (m.histLen == 0 || now - last < m.histInterval)
+      return;
+    last = now;
+
+    uint8_t fwd = 0;
+    uint8_t rl = 0;
+    if (m.isSignalPresent())
+    {
+      fwd = quantize(m.fwdp, 1);
+      rl = quantize(m.rl(), 0);
+    }
+
+    m.histFwd[m.histHead] = fwd;
+    m.histRl[m.histHead] = rl;
+    m.histHead = (m.histHead + 1) % m.histLen;
+    m.histCount++;
+  }
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include "model.h"
+#include "enc.h"
+
+#define IDLE_TIMEOUT_MS 5000L // Time without carrier or user activity before going idle
+#define IDLE_POLL_MS 20L      // RSSI polling interval while idle
+#define IDLE_CARRIER_LEVEL 20 // Single RSSI sample that ends the idle wait, as isSignalPresent()
+#define IDLE_FLOOR_MS 10000L  // Interval of the noise floor samples while idle
+
+/**
+ * @brief Class to manage the low-power idle mode used when no carrier is present.
+ *
+ * After IDLE_TIMEOUT_MS without a carrier, encoder or button activity the model
+ * is flagged idle. The ADC and display modules react to the flag by putting the
+ * LTC2309 to sleep and blanking the OLED, and the MCU sleeps in AVR idle mode
+ * between RSSI checks. Any interrupt wakes the MCU; an encoder or button
+ * change, a pending host command or an RSSI sample at the carrier level
+ * ends the wait early.
+ *
+ * Every IDLE_FLOOR_MS the model's floorDue flag wakes the ADC for a few
+ * readings, so the auto-zero of zero.h follows the detector drift between
+ * transmissions too. Zero clears the flag when it has its readings.
+ *
+ * The time from the last RSSI sample that saw no carrier to the first valid
+ * reading is stored in the model as the worst case key-down latency.
+ * test/test_native_idle keys a carrier at times spread over the poll
+ * interval and checks that the first reading and a protection trip follow
+ * within 10 ms, test/test_native_protect that the trip follows within the
+ * protection latency bound.
+ */
+class Idle
+{
+private:
+  Model &m; // Reference to the Model object holding the idle state
+
+  unsigned long lastActive = 0; // millis() of the last carrier or user activity
+  unsigned long lastPoll = 0;   // micros() of the last RSSI sample without a carrier
+  unsigned long lastFloor = 0;  // millis() when the last noise floor sample was asked for
+  bool waking = false;          // Left idle, first reading not yet done
+
+  // Notes activity and leaves the idle mode, timing the wake-up for a carrier.
+  void wake(bool carrier)
+  {
+    lastActive = millis();
+    if (m.idle)
+    {
+      m.idle = false;
+      m.floorDue = false;
+      waking = carrier;
+    }
+  }
+
+  // Samples the encoder and button pins to notice user activity while asleep.
+  inline uint8_t userPins()
+  {
+    return digitalRead(ENC_A) | (digitalRead(ENC_B) << 1) | (digitalRead(ENC_BUTTON) << 2);
+  }
+
+  /**
+   * @brief Sleeps in AVR idle mode until the next RSSI poll is due.
+   *
+   * The millis() timer interrupt wakes the MCU about once a millisecond, so
+   * the sleep is repeated until IDLE_POLL_MS has passed or user or host
+   * activity is seen. After each wake-up one RSSI sample, 112 us of
+   * conversion, is taken. A sample at the carrier level ends the idle mode
+   * right away, so the ADC is woken and its first sample pairs checked by
+   * the protection in the same loop round, about a millisecond after the
+   * carrier was keyed instead of at the next poll.
+   */
+  void sleep()
+  {
+    uint8_t pins = userPins();
+    unsigned long start = millis();
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (millis() - start < IDLE_POLL_MS)
+    {
+      sleep_mode();
+      if (Serial.available() > 0 || userPins() != pins)
+        break;
+      if (analogRead(A0) >= IDLE_CARRIER_LEVEL)
+      {
+        wake(true);
+        break;
+      }
+      lastPoll = micros();
+    }
+  }
+
+public:
+  /**
+   * @brief Constructor for the Idle class.
+   *
+   * @param model The model holding the idle state.
+   */
+  Idle(Model &model) : m(model) {}
+
+  void init()
+  {
+    lastActive = millis();
+  }
+
+  /**
+   * @brief Enters or leaves the idle mode and sleeps while idle.
+   *
+   * Should be called after the encoder and RSSI have been read, before the
+   * ADC is read.
+   */
+  void loop()
+  {
+    if (m.isSignalPresent() || m.enc_changed || m.but)
+    {
+      wake(m.isSignalPresent());
+      return;
+    }
+
+    if (!m.idle)
+    {
+      m.idle = millis() - lastActive > IDLE_TIMEOUT_MS;
+      if (!m.idle)
+        return;
+      lastFloor = millis();
+    }
+
+    if (!m.floorDue && millis() - lastFloor >= IDLE_FLOOR_MS)
+    {
+      m.floorDue = true;
+      lastFloor = millis();
+    }
+
+    lastPoll = micros();
+    sleep();
+  }
+
+  /**
+   * @brief Records the wake-up latency once the first valid reading is done.
+   *
+   * Should be called after the measurement has been calculated.
+   */
+  void measured()
+  {
+    if (!waking)
+      return;
+    m.wakeLatency = micros() - lastPoll;
+    waking = false;
+  }
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include "global.h"
+#include "model.h"
+
+#define LINK_HANDSHAKE_MS 1000UL  // Time for the host to confirm a new rate with K
+
+/**
+ * @brief Class to switch the serial link to a higher baud rate on the host's request.
+ *
+ * The U<baud> command is answered at the current rate, after which the UART
+ * is switched to the new rate. The host switches too and confirms with the K
+ * command within LINK_HANDSHAKE_MS; without it the link falls back to
+ * LINK_DEFAULT_BAUD, so a host that missed the switch can always reconnect.
+ * The new rate is announced at the new speed as {"link":<baud>}.
+ *
+ * The offered rates are exact with U2X (double speed) from the 16 MHz clock:
+ * UBRR 7, 3 and 1 for 250000, 500000 and 1000000 baud, where 57600 is off by
+ * 2.1 %. HardwareSerial::begin() selects U2X for these by itself.
+ *
+ * Once a second the data logger's output is turned into the effective
+ * throughput in bytes per second.
+ */
+class Link
+{
+private:
+  Model &m; // Reference to the Model object holding the link state
+  Print &out; // Serial output, polling the SWR protection while it waits, see tx.h
+
+  unsigned long switched = 0; // millis() when the rate was switched
+  unsigned long rateStart = 0; // millis() when the throughput was last updated
+
+  // Switches the UART to a new rate once everything sent has gone out.
+  void begin(uint32_t baud)
+  {
+    out.flush();
+    Serial.begin(baud);
+    m.linkBaud = baud;
+    out.print(F("{\"link\":"));
+    out.print(baud);
+    out.println(F("}"));
+  }
+
+public:
+  /**
+   * @brief Constructor for the Link class.
+   *
+   * @param model The model holding the link state.
+   * @param o Serial output drained before a rate switch.
+   */
+  Link(Model &model, Print &o) : m(model), out(o) {}
+
+  /**
+   * @brief Checks whether a rate can be requested with the U command.
+   *
+   * @param baud Requested rate.
+   * @return true for LINK_DEFAULT_BAUD and the exact U2X rates.
+   */
+  static bool supported(uint32_t baud)
+  {
+    return baud == LINK_DEFAULT_BAUD || baud == 250000UL || baud == 500000UL || baud == 1000000UL;
+  }
+
+  void init()
+  {
+    rateStart = millis();
+  }
+
+  /**
+   * @brief Carries out a requested rate switch and the handshake timeout.
+   *
+   * Should be called after the Cmd loop, so the U command has been
+   * answered at the old rate before the switch.
+   */
+  void loop()
+  {
+    unsigned long now = millis();
+
+    if (m.linkRequest != 0)
+    {
+      begin(m.linkRequest);
+      m.linkPending = m.linkRequest != LINK_DEFAULT_BAUD;
+      m.linkRequest = 0;
+      switched = now;
+    }
+    else if (m.linkPending && now - switched >= LINK_HANDSHAKE_MS)
+    {
+      m.linkPending = false;
+      m.linkFails++;
+      begin(LINK_DEFAULT_BAUD);
+    }
+
+    if (now - rateStart >= 1000)
+    {
+      m.linkRate = m.linkBytes * 1000UL / (now - rateStart);
+      m.linkBytes = 0;
+      rateStart = now;
+    }
+  }
+};
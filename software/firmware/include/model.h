@@ -1,11 +1,135 @@
 #pragma once
 
 #include "screen.h"
+#include "global.h"
+
+// Latest reading of one coupler port.
+struct PortReading
+{
+  // voltage from fwd log detector in 1/16 mV
+  uint16_t fwdV = 0;
+  // voltage from ref log detector in 1/16 mV
+  uint16_t refV = 0;
+  // Forward power in dBm
+  double fwdp = 0;
+  // Reflected power in dBm
+  double refp = 0;
+  // fwd detector voltage before clamping to zero in 1/16 mV
+  uint16_t fwdRaw = 0;
+  // ref detector voltage before clamping to zero in 1/16 mV
+  uint16_t refRaw = 0;
+  // tracked noise floor of the fwd detector in 1/16 mV
+  uint16_t fwdFloor = ZERO_FWD_NOMINAL * ADC_SCALE;
+  // tracked noise floor of the ref detector in 1/16 mV
+  uint16_t refFloor = ZERO_REF_NOMINAL * ADC_SCALE;
+  // fwd detector drift subtracted by Calc in 1/16 mV
+  int16_t fwdDrift = 0;
+  // ref detector drift subtracted by Calc in 1/16 mV
+  int16_t refDrift = 0;
+  // fwd floor latched as the zero of the drift in 1/16 mV
+  uint16_t fwdZero = 0;
+  // ref floor latched as the zero of the drift in 1/16 mV
+  uint16_t refZero = 0;
+  // floors settled and latched since power-up?
+  bool zeroLatched = false;
+};
+
+// Settings of one coupler port, taken from portConfigs in adc.h at start-up.
+struct PortSetting
+{
+  // fwd detector offset in mV, added to the reading
+  int16_t fwdTrim = 0;
+  // ref detector offset in mV, added to the reading
+  int16_t refTrim = 0;
+  // read the port on every n:th round-robin turn
+  uint8_t divider = 1;
+};
+
+// Band scan statistics of one frequency bin.
+struct ScanBin
+{
+  // bin number, frequency / bin width, SCAN_EMPTY if unused
+  uint16_t key;
+  // number of readings, stops at 255
+  uint8_t count;
+  // lowest SWR times 100
+  uint16_t minSwr;
+  // SWR times 100 summed over the mean window, the mean times the window
+  uint32_t swrSum;
+  // forward power in dBm times 10 summed over the mean window
+  int32_t fwdSum;
+
+  // Readings the means are taken over.
+  uint8_t window() const { return count < SCAN_MEAN_WINDOW ? count : SCAN_MEAN_WINDOW; }
+
+  // Mean SWR times 100, rounded.
+  uint16_t meanSwr() const { return (swrSum + window() / 2) / window(); }
+
+  // Mean forward power in dBm times 10, rounded.
+  int16_t meanFwd() const
+  {
+    int32_t half = window() / 2;
+    return (fwdSum + (fwdSum < 0 ? -half : half)) / window();
+  }
+};
+
+// Key of an unused band scan bin.
+#define SCAN_EMPTY 0xFFFF
+
+// Devices on the I2C bus, for attributing the bus errors.
+enum BusDevice
+{
+  BUS_ADC,
+  BUS_DISP,
+  BUS_DEVICES
+};
+
+// What the data logger sends, see the E command.
+enum LogMode : uint8_t
+{
+  LOG_SAMPLES,   // every measurement
+  LOG_SUMMARIES, // one summary per transmission, see segment.h
+  LOG_BOTH
+};
+
+// Derived values memoized by Model, one bit each.
+enum Derived : uint8_t
+{
+  DERIVED_FWDW = 1,
+  DERIVED_REFW = 2,
+  DERIVED_GAMMA = 4,
+  DERIVED_SWR = 8,
+  DERIVED_RL = 16,
+  DERIVED_LOSS = 32,
+  DERIVED_ALL = 63
+};
 
 class Model
 {
 private:
+  // Derived values of the current powers, valid where their bit is set in
+  // derived. They are computed when first read after setPowers(), and start
+  // cleared like after clear() until the first reading.
+  mutable uint8_t derived = DERIVED_ALL;
+  mutable double gammaMemo = 0;
+  mutable double swrMemo = 0;
+  mutable double rlMemo = 0;
+  mutable double fwdwMemo = 0;
+  mutable double refwMemo = 0;
+  mutable double lossMemo = 0;
+
+  // Checks whether a derived value still has to be computed for the current powers.
+  inline bool stale(Derived d) const {
+    if (derived & d)
+      return false;
+    derived |= d;
+    return true;
+  }
 
+  // Converts power from dBm to watts: W = 10^(dBm/10) / 1000.
+  static inline double dbm2w(double dbm) {
+    return pow(10, dbm / 10.0 - 3.0);
+  }
 
 public:
   Model() {};
@@ -28,11 +152,165 @@ public:
   uint32_t freq_squared;
   // the rssi voltage mV
   uint32_t rssiV;
-  // voltage from fwd log detector
+  // voltage from fwd log detector in 1/16 mV
   uint16_t fwdV;
-  // voltage from ref log detector
+  // voltage from ref log detector in 1/16 mV
   uint16_t refV;
 
+  // is the data logger streaming measurements?
+  bool logging = true;
+  // log only every n:th measurement
+  uint8_t decimation = 1;
+  // number of ADC samples averaged into one reading
+  uint16_t avgWindow = AWG_WINDOW;
+  // log the next measurement regardless of logging and decimation
+  bool capture = false;
+  // measurements, transmission summaries or both
+  LogMode logMode = LOG_SAMPLES;
+
+  // is a transmission in progress? Follows the RSSI with hysteresis
+  bool keyed = false;
+  // ID of the current or last transmission, wraps around
+  uint16_t txId = 0;
+
+  // low-power idle mode, no carrier for a while
+  bool idle = false;
+  // ADC woken in the idle mode for noise floor samples, see zero.h
+  bool floorDue = false;
+  // worst case key-down to first reading latency of the last wake-up in us
+  uint32_t wakeLatency = 0;
+
+  // 64-bit microsecond clock, extended from micros() by micros64()
+  uint64_t clockHigh = 0;
+  uint32_t clockLast = 0;
+  // host time minus local clock at the last sync in us
+  int64_t clockOffset = 0;
+  // local clock at the last sync
+  uint64_t clockSync = 0;
+  // crystal drift relative to the host in parts per billion
+  int32_t clockDrift = 0;
+  // host time minus corrected local time seen at the last sync in us
+  int32_t clockError = 0;
+  // has the host synced the clock?
+  bool clockSynced = false;
+  // local clock at the middle of the last ADC averaging window
+  uint64_t sampleTime = 0;
+
+  // trend history of forward power, 0 = no signal, else dBm * 4 but at least 1
+  uint8_t *histFwd = nullptr;
+  // trend history of return loss in 0.25 dB steps
+  uint8_t *histRl = nullptr;
+  // length of the history rings, 0 if there was no memory for them
+  uint8_t histLen = 0;
+  // history slot to be written next
+  uint8_t histHead = 0;
+  // number of history samples taken, wraps around
+  uint16_t histCount = 0;
+  // history sampling interval in ms
+  uint16_t histInterval = HISTORY_INTERVAL_MS;
+
+  // band scan bins, an open addressing hash table keyed by the bin number
+  ScanBin scan[SCAN_BINS];
+  // band scan bin width in kHz
+  uint16_t scanBinKhz = SCAN_BIN_KHZ;
+  // number of band scan bins in use
+  uint8_t scanUsed = 0;
+  // readings dropped because the band scan table was full
+  uint16_t scanDropped = 0;
+  // band scan updates, wraps around
+  uint16_t scanUpdates = 0;
+  // clear the band scan
+  bool scanClear = false;
+  // print the band scan
+  bool scanDump = false;
+
+  // SWR that trips the protection, times ten
+  uint8_t tripSwr10 = PROTECT_SWR10;
+  // is the SWR protection tripped?
+  bool tripped = false;
+  // local clock when the protection tripped
+  uint64_t tripTime = 0;
+  // peak forward detector code while tripped
+  uint16_t tripFwd = 0;
+  // peak reflected detector code while tripped
+  uint16_t tripRef = 0;
+
+  // readings of each coupler port
+  PortReading ports[PORT_COUNT];
+  // trims and rate divider of each coupler port, set by the I, J and N commands
+  PortSetting portSettings[PORT_COUNT];
+  // port of the latest ADC reading
+  uint8_t port = 0;
+  // port shown on the display, its readings are also in fwdV and refV
+  uint8_t selPort = 0;
+  // bit mask of the ports read by the ADC
+  uint8_t portMask = (1 << PORT_COUNT) - 1;
+  // I2C transactions timed out, per device
+  uint16_t busErrors[BUS_DEVICES] = {};
+  // I2C bus recoveries made
+  uint16_t busRecoveries = 0;
+  // MCUSR at start-up, bit 3 set after a watchdog reset
+  uint8_t resetCause = 0;
+
+  // correct the readings by the tracked detector drift?
+  bool zeroEnabled = false;
+  // aggregate ADC readings per second over all ports
+  uint16_t readingRate = 0;
+
+  // serial link rate in baud
+  uint32_t linkBaud = LINK_DEFAULT_BAUD;
+  // rate requested by the host, 0 = none
+  uint32_t linkRequest = 0;
+  // waiting for the host to confirm the new rate?
+  bool linkPending = false;
+  // rate switches not confirmed by the host
+  uint16_t linkFails = 0;
+  // bytes logged since the throughput was last updated
+  uint32_t linkBytes = 0;
+  // logged bytes per second
+  uint32_t linkRate = 0;
+  // records that had to wait for room in the serial buffer
+  uint32_t linkStalls = 0;
+  // rejected host commands
+  uint16_t cmdErrors = 0;
+
+  // print the profiling report, see profile.h
+  bool profileReport = false;
+
+  /**
+   * @brief Reads the 64-bit microsecond clock.
+   *
+   * Extends the 32-bit micros() counter, which wraps every 71 minutes, by
+   * counting its wrap-arounds. Must be called at least once per wrap period,
+   * which the main loop does through Time::loop().
+   *
+   * @return Microseconds since power-up.
+   */
+  inline uint64_t micros64()
+  {
+    uint32_t now = micros();
+    if (now < clockLast)
+      clockHigh += 1ULL << 32;
+    clockLast = now;
+    return clockHigh + now;
+  }
+
+  /**
+   * @brief Converts a local clock value to host time.
+   *
+   * Applies the offset and the drift estimated from the host syncs. Without
+   * a sync the local clock is returned as is. The drift term is computed on
+   * whole milliseconds to keep the product within 64 bits for years.
+   *
+   * @param local Local clock value in us.
+   * @return Host time in us.
+   */
+  inline uint64_t hostTime(uint64_t local) const
+  {
+    int64_t elapsed = static_cast<int64_t>(local - clockSync);
+    return local + clockOffset + (elapsed / 1000) * clockDrift / 1000000LL;
+  }
+
   /**
    * @brief Calculates the coupler's attenuation in dB as a function of the
    * frequency in kHz.
@@ -50,14 +328,75 @@ public:
   inline void clear() {
     fwdV = 0;
     refV = 0;
-    fwdw = 0;
-    refw = 0;
     fwdp = 0;
     refp = 0;
-    loss = 0;
-    rl = 0;
-    swr = 0;
-    gamma = 0;
+    fwdwMemo = 0;
+    refwMemo = 0;
+    lossMemo = 0;
+    rlMemo = 0;
+    swrMemo = 0;
+    gammaMemo = 0;
+    derived = DERIVED_ALL;
+    generation++;
+  };
+
+  /**
+   * @brief Stores a new pair of powers and starts a new sample generation.
+   *
+   * The derived values are not computed here but when they are read, at most
+   * once per generation, so only the values used by the current screen and
+   * the other consumers cost any time.
+   *
+   * @param fwd Forward power in dBm.
+   * @param ref Reflected power in dBm.
+   */
+  inline void setPowers(double fwd, double ref) {
+    fwdp = fwd;
+    refp = ref;
+    derived = 0;
+    generation++;
+  };
+
+  // Forward power in W
+  inline double fwdw() const {
+    if (stale(DERIVED_FWDW))
+      fwdwMemo = dbm2w(fwdp);
+    return fwdwMemo;
+  };
+
+  // Reflected power in W
+  inline double refw() const {
+    if (stale(DERIVED_REFW))
+      refwMemo = dbm2w(refp);
+    return refwMemo;
+  };
+
+  // Reflection coeficient
+  inline double gamma() const {
+    if (stale(DERIVED_GAMMA))
+      gammaMemo = sqrt(refw() / fwdw());
+    return gammaMemo;
+  };
+
+  // standing wave ratio
+  inline double swr() const {
+    if (stale(DERIVED_SWR))
+      swrMemo = (1 + gamma()) / (1 - gamma());
+    return swrMemo;
+  };
+
+  // return loss in dB
+  inline double rl() const {
+    if (stale(DERIVED_RL))
+      rlMemo = -20 * log10(gamma());
+    return rlMemo;
+  };
+
+  // Loss of Power in Watts: Forward Power * ((SWR - 1) / (SWR + 1))^2
+  inline double loss() const {
+    if (stale(DERIVED_LOSS))
+      lossMemo = fwdw() * ((swr() - 1) * (swr() - 1)) / ((swr() + 1) * (swr() + 1));
+    return lossMemo;
   };
 
 /**
@@ -74,25 +413,24 @@ public:
     return 1.354E-9 * static_cast<double>(freq_squared) - 1.858E-5 * static_cast<double>(freq) + 37.51;
   };
   
+  // Selects the next port enabled in portMask for display.
+  inline void nextPort() {
+    for (uint8_t i = 0; i < PORT_COUNT; i++) {
+      selPort = (selPort + 1) % PORT_COUNT;
+      if (portMask & (1 << selPort))
+        return;
+    }
+  };
+
   // is there a signal present?
   inline bool isSignalPresent() const {
     return (rssiV > 19);
   };
 
-  // Reflection coeficient
-  double gamma;
-  // standing wave ratio
-  double swr;
-  // return loss in dB
-  double rl;
-  // Forward power in W
-  double fwdw;
-  // Reflected power in W
-  double refw;
   // Forward power in dBm 
   double fwdp;
   // Reflected power in dBm 
   double refp;
-  // Loss of Power in Watts
-  double loss;
+  // power pairs stored by setPowers() or clear(), wraps around
+  uint16_t generation = 0;
 };
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <Arduino.h>
+#include "model.h"
+
+// Build with -D PROFILING (the "profile" environment in platformio.ini) to time
+// each module's loop() call and the whole loop per screen. Without it the
+// PROFILE() macro just makes the call and costs nothing.
+//
+// Sections are timed with micros(), or with the function named by
+// -D PROFILE_CLOCK=<function> counting PROFILE_TICK_CYCLES CPU cycles per
+// tick, such as the cycle counter of the benchmark in test/test_bench.
+//
+// Example of use:
+// PROFILE_LOOP_BEGIN();                  at the start of loop()
+// PROFILE(PROF_ADC, adc.loop());         times one call
+// PROFILE_LOOP_END();                    at the end of loop(), prints the report
+
+// Profiled code sections
+enum ProfileSlot
+{
+  PROF_ENC,
+  PROF_CMD,
+  PROF_LINK,
+  PROF_RSSI,
+  PROF_IDLE,
+  PROF_PROTECT,
+  PROF_ADC,
+  PROF_ZERO,
+  PROF_FREQ,
+  PROF_CALC,
+  PROF_LOG,
+  PROF_HISTORY,
+  PROF_SCAN,
+  PROF_SEGMENT,
+  PROF_TIME,
+  PROF_BUS,
+  PROF_POLL,
+  PROF_MODULES,                         // Number of module sections
+  PROF_DISP = PROF_MODULES,             // Display::loop(), one section per screen
+  PROF_LOOP = PROF_DISP + SCREEN_COUNT, // Whole loop, one section per screen
+  PROF_SLOTS = PROF_LOOP + SCREEN_COUNT
+};
+
+#ifdef PROFILING
+
+#ifdef PROFILE_CLOCK
+uint32_t PROFILE_CLOCK();
+#else
+#define PROFILE_CLOCK micros
+#define PROFILE_TICK_CYCLES clockCyclesPerMicrosecond()
+#endif
+
+#define PROFILE(slot, ...)                                     \
+  do                                                           \
+  {                                                            \
+    uint32_t profileStart = PROFILE_CLOCK();                   \
+    __VA_ARGS__;                                               \
+    profile.record((slot), PROFILE_CLOCK() - profileStart);    \
+  } while (0)
+
+#define PROFILE_LOOP_BEGIN() uint32_t profileLoopStart = PROFILE_CLOCK()
+
+#define PROFILE_LOOP_END()                                                      \
+  do                                                                            \
+  {                                                                             \
+    profile.record(PROF_LOOP + model.scr, PROFILE_CLOCK() - profileLoopStart);  \
+    profile.loop();                                                             \
+  } while (0)
+
+// Budgets in CPU cycles. The worst case of a section above its budget fails
+// the benchmark; tighten them as the code gets faster.
+#define PROFILE_BUDGET_DISP 320000UL // Display::loop() on any screen
+#define PROFILE_BUDGET_LOOP 800000UL // Whole loop on any screen
+
+const char profEnc[] PROGMEM = "enc";
+const char profCmd[] PROGMEM = "cmd";
+const char profLink[] PROGMEM = "link";
+const char profRssi[] PROGMEM = "rssi";
+const char profIdle[] PROGMEM = "idle";
+const char profProtect[] PROGMEM = "protect";
+const char profAdc[] PROGMEM = "adc";
+const char profZero[] PROGMEM = "zero";
+const char profFreq[] PROGMEM = "freq";
+const char profCalc[] PROGMEM = "calc";
+const char profLog[] PROGMEM = "log";
+const char profHistory[] PROGMEM = "history";
+const char profScan[] PROGMEM = "scan";
+const char profSegment[] PROGMEM = "segment";
+const char profTime[] PROGMEM = "time";
+const char profBus[] PROGMEM = "bus";
+const char profPoll[] PROGMEM = "poll";
+
+const char *const profNames[PROF_MODULES] PROGMEM = {
+    profEnc, profCmd, profLink, profRssi, profIdle, profProtect, profAdc, profZero,
+    profFreq, profCalc, profLog, profHistory, profScan, profSegment, profTime, profBus, profPoll};
+
+const uint32_t profBudgets[PROF_MODULES] PROGMEM = {
+    2000UL,   // enc
+    20000UL,  // cmd, a status report line fills the serial buffer
+    20000UL,  // link, a rate switch waits for the serial buffer to drain
+    40000UL,  // rssi, 16 analogRead() calls
+    400000UL, // idle, includes the sleep between polls
+    100000UL, // protect, includes a threshold table rebuild
+    400000UL, // adc, 2 x 16 I2C conversions
+    2000UL,   // zero
+    2000UL,   // freq
+    40000UL,  // calc
+    200000UL, // log, may wait for the serial buffer
+    4000UL,   // history
+    40000UL,  // scan, a dump line fills the serial buffer
+    40000UL,  // segment, a summary fills the serial buffer
+    1000UL,   // time
+    2000UL,   // bus, a recovery is timed with the module it follows
+    8000UL};  // poll, one protection sample pair
+
+/**
+ * @brief Class to collect and report the execution time of the profiled sections.
+ *
+ * Times are taken in ticks of PROFILE_CLOCK(). With micros(), which has a
+ * resolution of 4 us, the cycle counts reported are exact to 64 cycles at
+ * 16 MHz.
+ */
+class Profile
+{
+private:
+  Model &m; // Reference to the Model object holding the report request
+
+  uint32_t total[PROF_SLOTS]; // Sum of the section times in ticks
+  uint32_t worst[PROF_SLOTS]; // Longest section time in ticks
+  uint16_t count[PROF_SLOTS]; // Number of timed runs
+
+  /**
+   * @brief Prints the statistics of one section as a JSON line.
+   *
+   * @return true if the section stayed within its budget.
+   */
+  bool report(uint8_t slot)
+  {
+    bool ok = cycles(slot) <= budget(slot);
+
+    Serial.print(F("{\"b\":\""));
+    if (slot < PROF_MODULES)
+      Serial.print(reinterpret_cast<const __FlashStringHelper *>(pgm_read_ptr(&profNames[slot])));
+    else
+      Serial.print(slot < PROF_LOOP ? F("disp") : F("loop"));
+    Serial.print(F("\""));
+    if (slot >= PROF_MODULES)
+    {
+      Serial.print(F(",\"scr\":"));
+      Serial.print((slot - PROF_MODULES) % SCREEN_COUNT);
+    }
+    Serial.print(F(",\"n\":"));
+    Serial.print(count[slot]);
+    Serial.print(F(",\"avg\":"));
+    Serial.print(count[slot] ? total[slot] / count[slot] * PROFILE_TICK_CYCLES : 0);
+    Serial.print(F(",\"max\":"));
+    Serial.print(cycles(slot));
+    Serial.print(F(",\"budget\":"));
+    Serial.print(budget(slot));
+    Serial.print(F(",\"ok\":"));
+    Serial.print(ok ? 1 : 0);
+    Serial.println(F("}"));
+    return ok;
+  }
+
+public:
+  /**
+   * @brief Constructor for the Profile class.
+   *
+   * @param model The model holding the report request.
+   */
+  Profile(Model &model) : m(model) {}
+
+  /**
+   * @brief Clears the statistics.
+   */
+  void init()
+  {
+    memset(total, 0, sizeof(total));
+    memset(worst, 0, sizeof(worst));
+    memset(count, 0, sizeof(count));
+  }
+
+  /**
+   * @brief Adds one run of a section to its statistics.
+   *
+   * @param slot Section timed.
+   * @param ticks Time taken in PROFILE_CLOCK() ticks.
+   */
+  inline void record(uint8_t slot, uint32_t ticks)
+  {
+    if (count[slot] == UINT16_MAX)
+      return; // Keep the average consistent
+    total[slot] += ticks;
+    count[slot]++;
+    if (ticks > worst[slot])
+      worst[slot] = ticks;
+  }
+
+  // Returns the cycle budget of a section.
+  uint32_t budget(uint8_t slot) const
+  {
+    if (slot < PROF_MODULES)
+      return pgm_read_dword(&profBudgets[slot]);
+    return slot < PROF_LOOP ? PROFILE_BUDGET_DISP : PROFILE_BUDGET_LOOP;
+  }
+
+  // Returns the worst-case CPU cycles of a section.
+  uint32_t cycles(uint8_t slot) const { return worst[slot] * PROFILE_TICK_CYCLES; }
+
+  // Returns the number of timed runs of a section.
+  uint16_t runs(uint8_t slot) const { return count[slot]; }
+
+  /**
+   * @brief Prints the report and starts a new run.
+   *
+   * One JSON line per section with runs is followed by
+   * {"b":"end","fail":<n>} giving the number of sections over budget.
+   *
+   * @return The number of sections over budget.
+   */
+  uint8_t print()
+  {
+    uint8_t failed = 0;
+    for (uint8_t slot = 0; slot < PROF_SLOTS; slot++)
+    {
+      if (count[slot] > 0 && !report(slot))
+        failed++;
+    }
+    Serial.print(F("{\"b\":\"end\",\"fail\":"));
+    Serial.print(failed);
+    Serial.println(F("}"));
+    init();
+    return failed;
+  }
+
+  /**
+   * @brief Prints the report when requested, see print().
+   */
+  void loop()
+  {
+    if (!m.profileReport)
+      return;
+    m.profileReport = false;
+    print();
+  }
+};
+
+#else
+
+#define PROFILE(slot, ...) __VA_ARGS__
+#define PROFILE_LOOP_BEGIN()
+#define PROFILE_LOOP_END()
+
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <Arduino.h>
+#include "model.h"
+#include "calc.h"
+
+#define PROTECT_TRIP_PIN 7          // Output driven high while the SWR trip is latched
+#define PROTECT_TABLE_SHIFT 6       // Forward codes per table entry, as a power of two
+#define PROTECT_TABLE_SIZE (4096 >> PROTECT_TABLE_SHIFT)
+#define PROTECT_MIN_CODE 400        // Forward codes below this are noise and never trip
+#define PROTECT_FREQ_STEP_KHZ 100   // Frequency change that rebuilds the table
+#define PROTECT_NO_TRIP INT16_MAX   // Table entry that cannot trip
+
+/**
+ * @brief Class to trip the amplifier protection on high SWR.
+ *
+ * Every raw forward/reflected sample pair read by the Adc is checked against
+ * a threshold table indexed by the forward code, so the check is one table
+ * lookup, add and compare without any floating point. The table holds the
+ * lowest reflected code that means an SWR at or above the trip SWR, stored
+ * as an offset from the forward code. Both detectors have nearly the same
+ * slope, so the offset is almost constant within a table entry's range of
+ * forward codes. The table is rebuilt from the Calc conversions when the
+ * frequency or the trip SWR changes.
+ *
+ * Besides the averaging window of every reading, Adc::poll() feeds one extra
+ * pair between the other phases of the loop and between the display's text
+ * rows and panel pages, so the loop never runs more than a few milliseconds
+ * without a check. test/test_native_protect measures the worst-case detection
+ * latency through the whole loop.
+ *
+ * A trip drives PROTECT_TRIP_PIN high and latches the time and the peak codes
+ * in the model until reset by the R command or the button with no carrier.
+ */
+class Protect
+{
+private:
+  Model &m;         // Reference to the Model object holding the trip latch
+  const Calc &calc; // Conversions used to build the threshold table
+
+  int16_t table[PROTECT_TABLE_SIZE];  // Lowest tripping reflected code minus forward code
+  uint32_t tableFreq = 0;             // Frequency the table was built for
+  uint8_t tableSwr10 = 0;             // Trip SWR the table was built for
+
+  /**
+   * @brief Builds the threshold table for the current frequency and trip SWR.
+   */
+  void build()
+  {
+    double swr = m.tripSwr10 / 10.0;
+    double rlTrip = -20 * log10((swr - 1) / (swr + 1)); // Return loss at the trip SWR
+
+    for (uint8_t i = 0; i < PROTECT_TABLE_SIZE; i++)
+    {
+      uint16_t fwd = static_cast<uint16_t>(i) << PROTECT_TABLE_SHIFT;
+      double ref = calc.refVoltage(calc.fwdPower(fwd) - rlTrip);
+
+      if ((fwd | ((1 << PROTECT_TABLE_SHIFT) - 1)) < PROTECT_MIN_CODE || ref > 4095)
+        table[i] = PROTECT_NO_TRIP;
+      else
+        table[i] = static_cast<int16_t>(ceil(ref)) - fwd;
+    }
+
+    tableFreq = m.freq;
+    tableSwr10 = m.tripSwr10;
+  }
+
+  /**
+   * @brief Latches a trip or updates the peak codes of a latched one.
+   */
+  void trip(uint16_t fwd, uint16_t ref)
+  {
+    if (!m.tripped)
+    {
+      digitalWrite(PROTECT_TRIP_PIN, HIGH);
+      m.tripped = true;
+      m.tripTime = m.micros64();
+      m.tripFwd = 0;
+      m.tripRef = 0;
+    }
+    if (fwd > m.tripFwd)
+      m.tripFwd = fwd;
+    if (ref > m.tripRef)
+      m.tripRef = ref;
+  }
+
+public:
+  /**
+   * @brief Constructor for the Protect class.
+   *
+   * @param model The model holding the trip latch.
+   * @param c The conversions used to build the threshold table.
+   */
+  Protect(Model &model, const Calc &c) : m(model), calc(c) {}
+
+  void init()
+  {
+    pinMode(PROTECT_TRIP_PIN, OUTPUT);
+    digitalWrite(PROTECT_TRIP_PIN, LOW);
+    build();
+  }
+
+  /**
+   * @brief Checks one raw sample pair against the trip threshold.
+   *
+   * Called by the Adc for every sample pair it reads.
+   *
+   * @param fwd Forward detector code.
+   * @param ref Reflected detector code.
+   */
+  inline void check(uint16_t fwd, uint16_t ref)
+  {
+    if (static_cast<int16_t>(ref - fwd) >= table[fwd >> PROTECT_TABLE_SHIFT] || m.tripped)
+      trip(fwd, ref);
+  }
+
+  /**
+   * @brief Keeps the threshold table up to date and handles the reset.
+   *
+   * The trip latch is reset by the button with no carrier, or by clearing
+   * m.tripped, after which the trip output is released here. Should be
+   * called once per loop round.
+   */
+  void loop()
+  {
+    uint32_t df = m.freq > tableFreq ? m.freq - tableFreq : tableFreq - m.freq;
+    if (df >= PROTECT_FREQ_STEP_KHZ || m.tripSwr10 != tableSwr10)
+      build();
+
+    if (m.tripped && m.but && !m.isSignalPresent())
+      m.tripped = false;
+    if (!m.tripped)
+      digitalWrite(PROTECT_TRIP_PIN, LOW);
+  }
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Arduino.h>
+
+extern char *__brkval;   // End of the heap, 0 before the first malloc()
+extern char __heap_start; // Start of the heap, after the static data
+
+/**
+ * @brief Returns the SRAM still free between the heap and the stack.
+ *
+ * Measured from the stack pointer of the caller, so call it from a shallow
+ * stack depth for the memory left to the rest of the program.
+ *
+ * @return Free bytes, at most UINT16_MAX.
+ */
+inline uint16_t freeRam()
+{
+  char top;
+  char *heap = __brkval ? __brkval : &__heap_start;
+  if (&top <= heap)
+    return 0;
+  uint32_t gap = &top - heap;
+  return gap > UINT16_MAX ? UINT16_MAX : gap;
+}
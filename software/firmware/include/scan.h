@@ -0,0 +1,189 @@
+#pragma once
+
+#include <Arduino.h>
+#include "global.h"
+#include "model.h"
+
+/**
+ * @brief Class to build an SWR map of the frequencies transmitted on.
+ *
+ * Every new reading of the displayed port with a carrier updates the bin of
+ * its frequency, m.freq / m.scanBinKhz, in the band scan table of the model:
+ * the lowest and mean SWR and the mean forward power. The table is an open
+ * addressing hash with linear probing, so a sweep across a band builds the
+ * curve on the meter without a high-rate log. When the table is full,
+ * readings on new frequencies are dropped and counted, as are frequencies
+ * whose bin number does not fit below SCAN_EMPTY.
+ *
+ * The means are kept as sums over SCAN_MEAN_WINDOW readings, so a small
+ * change is not lost to integer division: each reading past the window
+ * replaces the rounded mean in the sum.
+ *
+ * The dump prints one JSON line per bin in frequency order, one line per
+ * loop round so it never holds up the measurement, followed by
+ * {"scan":<bins>,"drop":<n>}.
+ */
+class Scan
+{
+private:
+  Model &m; // Reference to the Model object holding the band scan table
+  Print &out; // Serial output, polling the SWR protection while it waits, see tx.h
+
+  uint16_t generation = 0; // Model power generation last used
+  bool dumping = false;    // Dump in progress
+  uint16_t dumped = 0;     // Key of the last bin printed, dumping from the lowest up
+  bool dumpedAny = false;  // A bin has been printed
+
+  /**
+   * @brief Finds the bin of a key or the free slot for it.
+   *
+   * @return Index into the table, or SCAN_BINS if the key is not in the
+   * table and there is no room.
+   */
+  uint8_t find(uint16_t key)
+  {
+    uint8_t i = key % SCAN_BINS;
+    for (uint8_t n = 0; n < SCAN_BINS; n++)
+    {
+      if (m.scan[i].key == key || m.scan[i].key == SCAN_EMPTY)
+        return i;
+      i = (i + 1) % SCAN_BINS;
+    }
+    return SCAN_BINS;
+  }
+
+  // Adds one reading to the bin of its frequency.
+  void record()
+  {
+    uint32_t key = m.freq / m.scanBinKhz;
+    uint8_t i = key < SCAN_EMPTY ? find(key) : SCAN_BINS;
+    if (i == SCAN_BINS)
+    {
+      m.scanDropped++;
+      return;
+    }
+
+    double swr = m.swr() * 100.0;
+    uint16_t swr100 = swr > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(swr);
+    int16_t fwd10 = static_cast<int16_t>(constrain(m.fwdp * 10.0, -32000.0, 32000.0));
+
+    ScanBin &b = m.scan[i];
+    if (b.key == SCAN_EMPTY)
+    {
+      b.key = key;
+      b.count = 0;
+      b.minSwr = swr100;
+      b.swrSum = 0;
+      b.fwdSum = 0;
+      m.scanUsed++;
+    }
+    if (swr100 < b.minSwr)
+      b.minSwr = swr100;
+
+    // Cumulative sums, moving sums once the window is full
+    if (b.count >= SCAN_MEAN_WINDOW)
+    {
+      b.swrSum -= b.meanSwr();
+      b.fwdSum -= b.meanFwd();
+    }
+    b.swrSum += swr100;
+    b.fwdSum += fwd10;
+    if (b.count < UINT8_MAX)
+      b.count++;
+    m.scanUpdates++;
+  }
+
+  /**
+   * @brief Prints the next bin of the dump.
+   *
+   * The bins are printed in key order by looking up the lowest key above the
+   * one printed last, so no sorted copy of the table is needed.
+   */
+  void dumpNext()
+  {
+    uint8_t next = SCAN_BINS;
+    for (uint8_t i = 0; i < SCAN_BINS; i++)
+    {
+      uint16_t key = m.scan[i].key;
+      if (key == SCAN_EMPTY || (dumpedAny && key <= dumped))
+        continue;
+      if (next == SCAN_BINS || key < m.scan[next].key)
+        next = i;
+    }
+
+    if (next == SCAN_BINS)
+    {
+      out.print(F("{\"scan\":"));
+      out.print(m.scanUsed);
+      out.print(F(",\"drop\":"));
+      out.print(m.scanDropped);
+      out.println(F("}"));
+      dumping = false;
+      return;
+    }
+
+    const ScanBin &b = m.scan[next];
+    out.print(F("{\"sf\":"));
+    out.print(static_cast<uint32_t>(b.key) * m.scanBinKhz);
+    out.print(F(",\"n\":"));
+    out.print(b.count);
+    out.print(F(",\"smin\":"));
+    out.print(b.minSwr / 100.0);
+    out.print(F(",\"smean\":"));
+    out.print(b.meanSwr() / 100.0);
+    out.print(F(",\"i\":"));
+    out.print(b.meanFwd() / 10.0, 1);
+    out.println(F("}"));
+    dumped = b.key;
+    dumpedAny = true;
+  }
+
+public:
+  /**
+   * @brief Constructor for the Scan class.
+   *
+   * @param model The model holding the band scan table.
+   * @param o Serial output for the dump.
+   */
+  Scan(Model &model, Print &o) : m(model), out(o) {}
+
+  /**
+   * @brief Empties the band scan table.
+   */
+  void init()
+  {
+    for (uint8_t i = 0; i < SCAN_BINS; i++)
+      m.scan[i].key = SCAN_EMPTY;
+    m.scanUsed = 0;
+    m.scanDropped = 0;
+    m.scanUpdates++;
+  }
+
+  /**
+   * @brief Adds a new reading to the band scan and runs the dump.
+   *
+   * Should be called after the measurement has been calculated.
+   */
+  void loop()
+  {
+    if (m.scanClear)
+    {
+      m.scanClear = false;
+      init();
+    }
+    if (m.scanDump && !dumping)
+    {
+      m.scanDump = false;
+      dumping = true;
+      dumpedAny = false;
+    }
+    if (dumping)
+      dumpNext();
+
+    if (m.generation == generation || !m.isSignalPresent())
+      return;
+    generation = m.generation;
+    if (m.freq > 0 && m.swr() >= 1.0)
+      record();
+  }
+};
@@ -6,5 +6,12 @@ enum Screen
   MAIN, // Represents the main screen of the application.
   INFO, // Represents an information screen that may display various details.
   DBM,  // Represents a screen that could display dBm (decibel-milliwatts) values or related metrics.
-  RAW   // Represents a screen that might show raw data or unprocessed information.
+  RAW,  // Represents a screen that might show raw data or unprocessed information.
+  TREND, // Represents a screen that plots the forward power and SWR history.
+  SCAN   // Represents a screen that plots the SWR against the frequency.
 };
+
+// The last screen in the selection order.
+constexpr Screen LAST_SCREEN = SCAN;
+// The number of screens.
+constexpr int SCREEN_COUNT = LAST_SCREEN + 1;
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+#include "model.h"
+#include "time.h"
+
+#define SEGMENT_KEY_MV 20     // RSSI that starts a transmission, as isSignalPresent()
+#define SEGMENT_UNKEY_MV 12   // RSSI below which the transmission may end
+#define SEGMENT_HANG_MS 500L  // Time the RSSI must stay low before the transmission ends
+#define SEGMENT_MAX_SWR 99.99 // Worst SWR reported, also for no or invalid reflection
+
+/**
+ * @brief Class to split the measurements into transmissions.
+ *
+ * A transmission starts when the RSSI rises to SEGMENT_KEY_MV and ends when
+ * it has stayed below SEGMENT_UNKEY_MV for SEGMENT_HANG_MS, so short dips
+ * such as the pauses of SSB speech do not split it. Each one gets the next
+ * ID and the model's keyed flag is set while it lasts.
+ *
+ * Every new reading of the displayed port during the transmission, from the
+ * one that keyed it, adds to its statistics: the number of readings, mean and peak forward power, worst
+ * SWR and the frequency. A pass counts only if the Adc read the displayed
+ * port in it, so a key-down on a pass without one, after a bus timeout or
+ * while another port was read, does not count the powers left in the model.
+ * At key-up they are printed as one line, unless the logging mode is
+ * LOG_SAMPLES, the default, or logging is stopped:
+ *
+ *   {"tx":<id>,"t":<ms>,"d":<ms>,"n":<readings>,"f":<kHz>,"ia":<dBm>,"ip":<dBm>,"s":<swr>}
+ *
+ * t is the key-down time like the record time stamps and d the time to the
+ * last RSSI above SEGMENT_UNKEY_MV. The power and SWR fields are left out
+ * when there was no reading.
+ */
+class Segment
+{
+private:
+  Model &m; // Reference to the Model object holding the keyed flag
+  Print &out; // Serial output, polling the SWR protection while it waits, see tx.h
+
+  uint64_t start = 0;           // Local clock at key-down
+  uint64_t lastHigh = 0;        // Local clock when the RSSI was last above SEGMENT_UNKEY_MV
+  unsigned long lowSince = 0;   // millis() when the RSSI dropped below SEGMENT_UNKEY_MV
+  bool low = false;             // RSSI below SEGMENT_UNKEY_MV while keyed
+  uint16_t count = 0;           // Readings in the transmission, stops at UINT16_MAX
+  double fwdSum = 0;            // Sum of the forward powers in W
+  double fwdPeak = 0;           // Highest forward power in dBm
+  double worstSwr = 0;          // Highest SWR
+  char stamp[25];               // Time stamp text of the summary
+
+  // Starts a new transmission.
+  void keyDown()
+  {
+    m.keyed = true;
+    m.txId++;
+    start = m.micros64();
+    lastHigh = start;
+    low = false;
+    count = 0;
+    fwdSum = 0;
+    fwdPeak = 0;
+    worstSwr = 0;
+  }
+
+  // Adds the current powers of the model to the statistics.
+  void record()
+  {
+    if (count < UINT16_MAX)
+      count++;
+    fwdSum += m.fwdw();
+    if (count == 1 || m.fwdp > fwdPeak)
+      fwdPeak = m.fwdp;
+
+    double swr = m.swr();
+    if (!(swr >= 1.0 && swr < SEGMENT_MAX_SWR)) // Also catches NaN
+      swr = SEGMENT_MAX_SWR;
+    if (swr > worstSwr)
+      worstSwr = swr;
+  }
+
+  // Prints the summary of the transmission that just ended.
+  void summary()
+  {
+    out.print(F("{\"tx\":"));
+    out.print(m.txId);
+    out.print(F(",\"t\":"));
+    out.print(formatMicros(stamp, m.hostTime(start)));
+    out.print(F(",\"d\":"));
+    out.print(static_cast<uint32_t>((lastHigh - start) / 1000));
+    out.print(F(",\"n\":"));
+    out.print(count);
+    out.print(F(",\"f\":"));
+    out.print(m.freq);
+    if (count > 0)
+    {
+      // Mean of the powers in W, as a power in dBm
+      out.print(F(",\"ia\":"));
+      out.print(10.0 * log10(fwdSum / count) + 30.0, 3);
+      out.print(F(",\"ip\":"));
+      out.print(fwdPeak, 3);
+      out.print(F(",\"s\":"));
+      out.print(worstSwr);
+    }
+    out.println(F("}"));
+  }
+
+public:
+  /**
+   * @brief Constructor for the Segment class.
+   *
+   * @param model The model holding the keyed flag.
+   * @param o Serial output for the summaries.
+   */
+  Segment(Model &model, Print &o) : m(model), out(o) {}
+
+  void init() {}
+
+  /**
+   * @brief Follows the RSSI edges and the readings of the transmission.
+   *
+   * Should be called once per loop round after the measurement has been
+   * calculated.
+   *
+   * @param fresh true if the Adc stored a new reading in this round.
+   */
+  void loop(bool fresh)
+  {
+    if (!m.keyed)
+    {
+      if (m.rssiV < SEGMENT_KEY_MV)
+        return;
+      keyDown();
+    }
+
+    if (m.rssiV >= SEGMENT_UNKEY_MV)
+    {
+      lastHigh = m.micros64();
+      low = false;
+    }
+    else if (!low)
+    {
+      low = true;
+      lowSince = millis();
+    }
+    else if (millis() - lowSince >= SEGMENT_HANG_MS)
+    {
+      m.keyed = false;
+      if (m.logging && m.logMode != LOG_SAMPLES)
+        summary();
+      return;
+    }
+
+    // The reading that keyed counts too
+    if (fresh && m.port == m.selPort && m.isSignalPresent())
+      record();
+  }
+};
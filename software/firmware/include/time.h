@@ -1,12 +1,43 @@
 #pragma once
 #include "model.h"
 
+#define TIME_MIN_DRIFT_SPAN_US 60000000LL // Shortest sync interval used for drift estimation
+#define TIME_MAX_SYNC_ERROR_US 100000LL   // Larger sync errors are taken as a time step
+#define TIME_MAX_DRIFT_PPB 10000000L      // Drift estimate limit, 1 %
+
+/**
+ * @brief Formats a microsecond time as milliseconds with three decimals.
+ *
+ * The 64-bit value is split into 32-bit parts so that no 64-bit division by
+ * ten is needed per digit.
+ *
+ * @param buf Buffer of at least 25 characters.
+ * @param us Time in microseconds.
+ * @return buf.
+ */
+inline char *formatMicros(char *buf, uint64_t us)
+{
+  uint32_t fraction = us % 1000;
+  uint64_t ms = us / 1000;
+  uint32_t high = ms / 1000000000UL;
+  uint32_t low = ms % 1000000000UL;
+
+  if (high > 0)
+    sprintf_P(buf, PSTR("%lu%09lu.%03lu"), (unsigned long)high, (unsigned long)low, (unsigned long)fraction);
+  else
+    sprintf_P(buf, PSTR("%lu.%03lu"), (unsigned long)low, (unsigned long)fraction);
+  return buf;
+}
+
 // Class to manage time-related operations and updates for a Model.
 class Time
 {
 private:
   Model &m; // Reference to a Model object to update its timing information.
 
+  uint64_t refLocal = 0; // Local clock at the start of the drift estimation
+  uint64_t refHost = 0;  // Host time at the start of the drift estimation
+
 public:
   // Constructor that initializes the Time object with a reference to a Model.
   explicit Time(Model &model) : m(model) {}
@@ -20,6 +51,7 @@ public:
   void init()
   {
     m.time = millis();
+    m.micros64();
   }
 
   /**
@@ -27,12 +59,63 @@ public:
    *
    * Calculates the elapsed time since the last call to this function
    * and updates the model's loopTime with this duration. Also updates
-   * the model's time with the current time from the millis function.
+   * the model's time with the current time from the millis function,
+   * and keeps the 64-bit microsecond clock running.
    */
   void loop()
   {
     unsigned long currentMillis = millis(); // Capture the current time once for efficiency.
     m.loopTime = currentMillis - m.time;    // Calculate the elapsed time since the last update.
     m.time = currentMillis;                 // Update the model's time to the current time.
+    m.micros64();                           // Catch micros() wrap-arounds.
+  }
+
+  /**
+   * @brief Synchronizes the clock to the host time.
+   *
+   * Every sync sets the offset so that the corrected clock matches the host.
+   * The drift is estimated from the host and local time elapsed since the
+   * first sync, once at least TIME_MIN_DRIFT_SPAN_US has passed, so the
+   * estimate improves as the session goes on. An error larger than
+   * TIME_MAX_SYNC_ERROR_US is taken as a step of the host clock and restarts
+   * the drift estimation.
+   *
+   * @param hostUs Host time in us when the sync command was sent.
+   * @param local Local clock when the first byte of the command arrived.
+   */
+  void sync(uint64_t hostUs, uint64_t local)
+  {
+    if (m.clockSynced)
+    {
+      int64_t error = static_cast<int64_t>(hostUs - m.hostTime(local));
+      m.clockError = constrain(error, static_cast<int64_t>(INT32_MIN), static_cast<int64_t>(INT32_MAX));
+
+      if (error > TIME_MAX_SYNC_ERROR_US || error < -TIME_MAX_SYNC_ERROR_US)
+      {
+        m.clockDrift = 0;
+        refLocal = local;
+        refHost = hostUs;
+      }
+      else
+      {
+        int64_t span = static_cast<int64_t>(local - refLocal);
+        if (span >= TIME_MIN_DRIFT_SPAN_US)
+        {
+          // Host minus local elapsed time, scaled to ppb on millisecond span
+          int64_t diff = static_cast<int64_t>(hostUs - refHost) - span;
+          int64_t drift = diff * 1000000LL / (span / 1000);
+          m.clockDrift = constrain(drift, -TIME_MAX_DRIFT_PPB, TIME_MAX_DRIFT_PPB);
+        }
+      }
+    }
+    else
+    {
+      refLocal = local;
+      refHost = hostUs;
+    }
+
+    m.clockOffset = static_cast<int64_t>(hostUs - local);
+    m.clockSync = local;
+    m.clockSynced = true;
   }
 };
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include "adc.h"
+
+/**
+ * @brief Serial output that keeps the SWR protection running while it waits.
+ *
+ * HardwareSerial::write() spins while the transmit buffer is full, so a line
+ * printed behind a measurement record blocks the loop for up to the whole
+ * buffer's transmit time, 11 ms at 57600 baud. Output printed through Tx
+ * waits for the room of each byte in Adc::poll() instead, so the protection
+ * gets a sample pair every few bytes however slow the link is. When no pair
+ * can be read, in the idle mode or with the bus timed out, it waits in
+ * HardwareSerial as before.
+ */
+class Tx : public Print
+{
+private:
+  Adc &adc; // ADC polled for the SWR protection while waiting
+
+public:
+  /**
+   * @brief Constructor for the Tx class.
+   *
+   * @param a ADC polled for the SWR protection while waiting.
+   */
+  Tx(Adc &a) : adc(a) {}
+
+  size_t write(uint8_t c) override
+  {
+    while (Serial.availableForWrite() == 0 && adc.poll())
+      ;
+    return Serial.write(c);
+  }
+  using Print::write;
+
+  int availableForWrite() override
+  {
+    return Serial.availableForWrite();
+  }
+
+  // Waits until everything printed has been sent.
+  void flush() override
+  {
+    while (Serial.availableForWrite() < SERIAL_TX_BUFFER_SIZE - 1 && adc.poll())
+      ;
+    Serial.flush();
+  }
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <Arduino.h>
+#include "global.h"
+#include "model.h"
+
+#define ZERO_SETTLE_MS 500L  // Time after the carrier before the detectors are back at the floor
+#define ZERO_WINDOW 256      // Readings after which the floor turns into a moving average
+#define ZERO_REJECT 100      // Readings this far above the floor are not noise, in mV
+#define ZERO_MAX_DRIFT 60    // Largest drift corrected, in mV
+#define ZERO_LATCH 64        // Readings after which the first floor is latched as the zero
+#define ZERO_WAKE_MS 50L     // Time the ADC is given to settle when woken for floor samples
+#define ZERO_IDLE_READINGS 32 // Readings taken per floor sample while idle
+
+/**
+ * @brief Class to track the detectors' noise floor while there is no carrier.
+ *
+ * With no carrier every new ADC reading updates a slow average of both
+ * detector outputs of the port read, starting from ZERO_FWD_NOMINAL and
+ * ZERO_REF_NOMINAL, kept in 1/16 mV like the readings. Once ZERO_LATCH
+ * readings have been averaged after power-up, the floors are latched as the
+ * port's zero. Nothing is computed here while a carrier is present.
+ *
+ * The correction is off by default. Turned on with Z1, the Adc clamps
+ * readings within ZERO_MARGIN of the floor to zero, and the floor's drift
+ * from the latched zero, which follows the detector temperature, is stored
+ * for Calc to subtract with the reading. Until the floors are latched the
+ * drift is zero.
+ *
+ * Readings taken soon after the carrier, while the detectors decay, are
+ * ignored, and once the average is settled so are readings far above the
+ * floor.
+ *
+ * In the idle mode the ADC sleeps, so Idle wakes it every IDLE_FLOOR_MS by
+ * setting the model's floorDue flag. The readings of the first ZERO_WAKE_MS
+ * are skipped while the ADC settles, and after ZERO_IDLE_READINGS more the
+ * flag is cleared and the ADC sleeps again. With one reading per 20 ms idle
+ * poll the ADC is awake for less than a tenth of the idle time, and the
+ * floors follow the drift with a time constant of about
+ * ZERO_WINDOW / ZERO_IDLE_READINGS * IDLE_FLOOR_MS, 80 s.
+ */
+class Zero
+{
+private:
+  Model &m; // Reference to the Model object holding the noise floors
+
+  uint32_t fwdQ[PORT_COUNT];    // fwd floor in 1/4096 mV
+  uint32_t refQ[PORT_COUNT];    // ref floor in 1/4096 mV
+  uint16_t count[PORT_COUNT];   // Readings averaged, stops at ZERO_WINDOW
+  uint64_t lastSample = 0;      // Local time of the last reading used
+  unsigned long lastSignal = 0; // millis() when the carrier was last seen
+  bool sampling = false;        // Taking a floor sample while idle
+  unsigned long wokenAt = 0;    // millis() when the ADC was woken for it
+  uint8_t idleReadings = 0;     // Readings used of it
+
+  /**
+   * @brief Adds one reading to a floor average.
+   *
+   * @param q Floor in 1/4096 mV.
+   * @param raw Reading in 1/16 mV.
+   * @param n Readings in the average.
+   * @return The floor in 1/16 mV.
+   */
+  static uint16_t track(uint32_t &q, uint16_t raw, uint16_t n)
+  {
+    if (n < ZERO_WINDOW || raw < (q >> 8) + ZERO_REJECT * ADC_SCALE)
+      q += (static_cast<int32_t>(static_cast<uint32_t>(raw) << 8) - static_cast<int32_t>(q)) / n;
+    return q >> 8;
+  }
+
+  // Limits a drift from the latched zero to ZERO_MAX_DRIFT, zero when the
+  // correction is off or nothing is latched yet.
+  inline int16_t drift(const PortReading &r, uint16_t floor, uint16_t zero)
+  {
+    if (!m.zeroEnabled || !r.zeroLatched)
+      return 0;
+    return constrain(static_cast<int16_t>(floor - zero),
+                     -ZERO_MAX_DRIFT * ADC_SCALE, ZERO_MAX_DRIFT * ADC_SCALE);
+  }
+
+  /**
+   * @brief Paces a floor sample taken while idle.
+   *
+   * @param now millis() of the reading.
+   * @return true if the reading is to be used, false while the ADC settles.
+   */
+  bool idleReading(unsigned long now)
+  {
+    if (!sampling)
+    {
+      sampling = true;
+      wokenAt = now;
+      idleReadings = 0;
+    }
+    if (now - wokenAt < ZERO_WAKE_MS)
+      return false;
+    if (++idleReadings >= ZERO_IDLE_READINGS)
+    {
+      m.floorDue = false; // Let the ADC sleep again
+      sampling = false;
+    }
+    return true;
+  }
+
+public:
+  /**
+   * @brief Constructor for the Zero class.
+   *
+   * @param model The model holding the noise floors.
+   */
+  Zero(Model &model) : m(model) {}
+
+  /**
+   * @brief Starts the floors from the nominal values.
+   */
+  void init()
+  {
+    for (uint8_t p = 0; p < PORT_COUNT; p++)
+    {
+      fwdQ[p] = static_cast<uint32_t>(ZERO_FWD_NOMINAL * ADC_SCALE) << 8;
+      refQ[p] = static_cast<uint32_t>(ZERO_REF_NOMINAL * ADC_SCALE) << 8;
+      count[p] = 0;
+    }
+  }
+
+  /**
+   * @brief Updates the noise floor of the port read with no carrier.
+   *
+   * Also while idle, from the floor samples. Should be called after the Adc
+   * loop.
+   */
+  void loop()
+  {
+    unsigned long now = millis();
+    if (!m.floorDue)
+      sampling = false;
+    if (m.isSignalPresent())
+    {
+      lastSignal = now;
+      return;
+    }
+    if (m.sampleTime == lastSample || now - lastSignal < ZERO_SETTLE_MS)
+      return;
+    lastSample = m.sampleTime;
+    if (m.floorDue && !idleReading(now))
+      return;
+
+    uint8_t p = m.port;
+    PortReading &r = m.ports[p];
+    if (count[p] < ZERO_WINDOW)
+      count[p]++;
+    r.fwdFloor = track(fwdQ[p], r.fwdRaw, count[p]);
+    r.refFloor = track(refQ[p], r.refRaw, count[p]);
+    if (!r.zeroLatched && count[p] >= ZERO_LATCH)
+    {
+      r.fwdZero = r.fwdFloor;
+      r.refZero = r.refFloor;
+      r.zeroLatched = true;
+    }
+    r.fwdDrift = drift(r, r.fwdFloor, r.fwdZero);
+    r.refDrift = drift(r, r.refFloor, r.refZero);
+  }
+};
@@ -4,7 +4,9 @@
 
 #include "debug.h"
 #include "adc.h"
+#include "tx.h"
 #include "calc.h"
+#include "protect.h"
 #include "time.h"
 #include "display.h"
 #include "model.h"
@@ -12,51 +14,106 @@
 #include "freq.h"
 #include "rssi.h"
 #include "datalogger.h"
+#include "cmd.h"
+#include "link.h"
+#include "idle.h"
+#include "history.h"
+#include "scan.h"
+#include "segment.h"
+#include "zero.h"
+#include "bus.h"
+#include "profile.h"
 
 Model model;
-Adc adc(model);
 Calc calc(model);
-Display disp(model);
+Protect protect(model, calc);
+Adc adc(model, protect);
+Tx tx(adc);
+Time time(model);
+Cmd cmd(model, time, tx);
+Display disp(model, adc, cmd);
 Enc enc(model);
 Freq freq(model);
 Rssi rssi(model);
-Time time(model);
-DataLogger logger(model);
+DataLogger logger(model, tx);
+Link link(model, tx);
+Idle idle(model);
+History history(model);
+Scan scan(model, tx);
+Segment segment(model, tx);
+Zero zero(model);
+Bus bus(model, adc, disp);
+#ifdef PROFILING
+Profile profile(model);
+#endif
 
 // the setup function runs once when you press reset or power the board
 void setup()
 {
   //debug_init(); // initialize the debugger
   // breakpoint();   // stop execution here
-  Serial.begin(57600);
+  Serial.begin(LINK_DEFAULT_BAUD);
 
   Wire.begin();
+  Wire.setClock(I2C_CLOCK_HZ);
+  bus.init();
 
   model.init();
+  // The display polls the ADC for the protection, so they go first
+  calc.init();
+  protect.init();
+  adc.init();
   disp.init();
   time.init();
   rssi.init();
-  adc.init();
-  calc.init();
   enc.init();
   freq.init();
+  cmd.init();
+  link.init();
+  idle.init();
+  history.init();
+  scan.init();
+  segment.init();
+  zero.init();
+#ifdef PROFILING
+  profile.init();
+#endif
 }
 
 // the loop function runs over and over again until power down or reset
 void loop()
 {
-  enc.loop();
-  rssi.loop();
-  adc.loop();
+  PROFILE_LOOP_BEGIN();
+  PROFILE(PROF_ENC, enc.loop());
+  PROFILE(PROF_CMD, cmd.loop());
+  PROFILE(PROF_LINK, link.loop());
+  PROFILE(PROF_RSSI, rssi.loop());
+  PROFILE(PROF_IDLE, idle.loop());
+  PROFILE(PROF_PROTECT, protect.loop());
+  bool fresh = false;
+  PROFILE(PROF_ADC, fresh = adc.loop(); bus.check(BUS_ADC));
+  PROFILE(PROF_ZERO, zero.loop());
   if (model.isSignalPresent())
   {
-    freq.loop();
-    calc.loop();
-    logger.loop();
+    PROFILE(PROF_FREQ, freq.loop());
+    // Only a new reading is calculated and logged, not the last one again
+    if (fresh)
+    {
+      PROFILE(PROF_CALC, calc.loop());
+      idle.measured();
+      PROFILE(PROF_POLL, adc.poll(); bus.check(BUS_ADC); cmd.watch());
+      PROFILE(PROF_LOG, logger.loop());
+    }
   } else if (model.but) {
     model.clear();
   }
-  time.loop();
-  disp.loop();
+  PROFILE(PROF_HISTORY, history.loop());
+  PROFILE(PROF_SCAN, scan.loop());
+  PROFILE(PROF_SEGMENT, segment.loop(fresh));
+  PROFILE(PROF_TIME, time.loop());
+  PROFILE(PROF_POLL, adc.poll(); bus.check(BUS_ADC); cmd.watch());
+  PROFILE(PROF_DISP + model.scr, disp.loop(); bus.check(BUS_DISP));
+  PROFILE(PROF_POLL, adc.poll(); bus.check(BUS_ADC); cmd.watch());
+  PROFILE(PROF_BUS, bus.loop());
+  PROFILE_LOOP_END();
 }
-
@@ -0,0 +1,127 @@
+#!/bin/sh
+# Tests the host tools against meters played by "pmrecv --sim" on
+# pseudo-terminals: pmrecv must negotiate 1 Mbaud and receive records with
+# no bad lines, pmrecv --enob must find the bits gained by the windows,
+# pmmerge must negotiate 1 Mbaud with two meters and merge them into one
+# time-ordered series.
+#
+# Usage: test/host/test_tools.sh [seconds], from the firmware directory.
+
+set -u
+seconds=${1:-3}
+tools=$(dirname "$0")/../../tools
+work=$(mktemp -d)
+sims=""
+failures=0
+
+cleanup()
+{
+  [ -n "$sims" ] && kill $sims 2>/dev/null
+  rm -rf "$work"
+}
+trap cleanup EXIT
+
+fail()
+{
+  echo "FAIL: $1"
+  failures=$((failures + 1))
+}
+
+pass()
+{
+  echo "PASS: $1"
+}
+
+# Starts a simulated meter sending $1 records/s and sets pty to its device.
+simulate()
+{
+  "$work/pmrecv" --sim -r "$1" > "$work/sim$1" &
+  sims="$sims $!"
+  pty=""
+  for i in 1 2 3 4 5 6 7 8 9 10; do
+    pty=$(head -n 1 "$work/sim$1" 2>/dev/null)
+    [ -n "$pty" ] && break
+    sleep 0.1
+  done
+  [ -n "$pty" ] || { echo "FAIL: no simulated meter"; exit 1; }
+}
+
+g++ -std=c++11 -O2 -Wall -o "$work/pmrecv" "$tools/pmrecv.cpp" || exit 1
+g++ -std=c++11 -O2 -Wall -pthread -o "$work/pmmerge" "$tools/pmmerge.cpp" || exit 1
+
+# pmrecv: handshake, record flow and no bad lines
+simulate 2000
+timeout -s INT "$seconds" "$work/pmrecv" -b 1000000 "$pty" > "$work/recv.jsonl" 2> "$work/recv.err"
+if grep -q "receiving at 1000000 baud" "$work/recv.err"; then
+  pass "pmrecv negotiates 1000000 baud"
+else
+  fail "pmrecv negotiates 1000000 baud"
+fi
+
+records=$(grep -c '^{"t":' "$work/recv.jsonl")
+if [ "$records" -ge $((1000 * (seconds - 1))) ]; then
+  pass "pmrecv receives $records records"
+else
+  fail "pmrecv receives $records records"
+fi
+
+reports=$(grep -c "records/s" "$work/recv.err")
+if [ "$reports" -gt 0 ] && ! grep "records/s" "$work/recv.err" | grep -vq " 0 bad lines"; then
+  pass "pmrecv reports no bad lines"
+else
+  fail "pmrecv reports no bad lines"
+  cat "$work/recv.err"
+fi
+
+# pmrecv --enob: every window measured, about half a bit gained per octave
+timeout -s INT 30 "$work/pmrecv" --enob -n 200 "$pty" > "$work/enob.txt" 2> "$work/enob.err"
+windows=$(awk 'NR > 1' "$work/enob.txt" | wc -l)
+gained=$(awk '$1 == 1 { first = $5 } $1 == 256 { last = $5 } END { print (last - first >= 3.5 && last - first <= 4.5) ? "yes" : "no" }' "$work/enob.txt")
+if [ "$windows" -eq 9 ] && [ "$gained" = "yes" ]; then
+  pass "pmrecv --enob gains 4 bits over 9 windows"
+else
+  fail "pmrecv --enob gains 4 bits over 9 windows"
+  cat "$work/enob.txt" "$work/enob.err"
+fi
+
+# pmmerge: two meters merged in time order
+simulate 1000
+first=$pty
+simulate 1500
+timeout -s INT "$seconds" "$work/pmmerge" -b 1000000 -o "$work/merged.csv" "$first" "$pty" 2> "$work/merge.err"
+if [ "$(grep -c "at 1000000 baud" "$work/merge.err")" -eq 2 ]; then
+  pass "pmmerge negotiates 1000000 baud with both meters"
+else
+  fail "pmmerge negotiates 1000000 baud with both meters"
+fi
+
+if [ "$(head -n 1 "$work/merged.csv")" = "t_ms,dev,port,f_khz,fwd_dbm,ref_dbm" ]; then
+  pass "pmmerge writes the header"
+else
+  fail "pmmerge writes the header"
+fi
+
+for dev in 0 1; do
+  rows=$(awk -F, -v d=$dev 'NR > 1 && $2 == d' "$work/merged.csv" | wc -l)
+  if [ "$rows" -ge $((500 * (seconds - 1))) ]; then
+    pass "pmmerge merges $rows records of meter $dev"
+  else
+    fail "pmmerge merges $rows records of meter $dev"
+  fi
+done
+
+if awk -F, 'NR > 2 && $1 < last { bad = 1 } NR > 1 { last = $1 } END { exit bad }' "$work/merged.csv"; then
+  pass "pmmerge writes the records in time order"
+else
+  fail "pmmerge writes the records in time order"
+fi
+
+if grep -q "synced" "$work/merge.err" && ! grep "records/s" "$work/merge.err" | grep -vq " 0 bad$"; then
+  pass "pmmerge syncs the meters with no bad lines"
+else
+  fail "pmmerge syncs the meters with no bad lines"
+  cat "$work/merge.err"
+fi
+
+echo "$failures failures"
+[ "$failures" -eq 0 ]
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+#include "sim.h"
+
+#define GFX_CHAR_US 100 // Drawing one 5x7 character, about 1600 cycles at 16 MHz
+#define GFX_ROWS 4      // Text rows kept for the tests, 8 pixels each
+#define GFX_COLUMNS 21  // Characters per text row, 6 pixels each
+
+/**
+ * Stand-in for the Adafruit GFX library. Lines are drawn pixel by pixel
+ * through drawPixel() like the real one. Text is not rendered: each character
+ * takes GFX_CHAR_US and, on the host, is kept in rows for the tests to read
+ * back, wrapping at the right edge like the real library.
+ */
+class Adafruit_GFX : public Print
+{
+protected:
+  int16_t _width;
+  int16_t _height;
+  int16_t cursor_x = 0;
+  int16_t cursor_y = 0;
+  uint16_t textcolor = 1;
+  uint8_t textsize = 1;
+
+public:
+#ifndef __AVR__
+  static inline char rows[GFX_ROWS][GFX_COLUMNS + 1] = {}; // Text on the screen
+
+  // Clears the kept text.
+  static void clearRows() { memset(rows, 0, sizeof(rows)); }
+#endif
+
+  Adafruit_GFX(int16_t w, int16_t h) : _width(w), _height(h) {}
+  virtual ~Adafruit_GFX() {}
+
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+  {
+    for (int16_t i = 0; i < h; i++)
+      drawPixel(x, y + i, color);
+  }
+
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+  {
+    for (int16_t i = 0; i < w; i++)
+      drawPixel(x + i, y, color);
+  }
+
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+  {
+    for (int16_t i = 0; i < w; i++)
+      drawFastVLine(x + i, y, h, color);
+  }
+
+  void setCursor(int16_t x, int16_t y)
+  {
+    cursor_x = x;
+    cursor_y = y;
+  }
+
+  void setTextColor(uint16_t c) { textcolor = c; }
+  void setTextSize(uint8_t s) { textsize = s; }
+  int16_t width() const { return _width; }
+  int16_t height() const { return _height; }
+
+  size_t write(uint8_t c) override
+  {
+    if (c == '\n')
+    {
+      cursor_x = 0;
+      cursor_y += 8 * textsize;
+      return 1;
+    }
+    if (c == '\r')
+      return 1;
+    if (cursor_x + 6 * textsize > _width)
+    {
+      cursor_x = 0;
+      cursor_y += 8 * textsize;
+    }
+#ifndef __AVR__
+    int16_t row = cursor_y / 8;
+    int16_t column = cursor_x / 6;
+    if (row >= 0 && row < GFX_ROWS && column >= 0 && column < GFX_COLUMNS)
+      rows[row][column] = c;
+#endif
+    simSpend(GFX_CHAR_US);
+    cursor_x += 6 * textsize;
+    return 1;
+  }
+  using Print::write;
+};
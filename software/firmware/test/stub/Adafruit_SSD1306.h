@@ -0,0 +1,121 @@
+#pragma once
+
+#include <Wire.h>
+#include <Adafruit_GFX.h>
+
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_INVERSE 2
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_EXTERNALVCC 0x01
+#define SSD1306_COLUMNADDR 0x21
+#define SSD1306_PAGEADDR 0x22
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+#define SSD1306_INIT_COMMANDS 25 // Command bytes sent by begin()
+
+/**
+ * Stand-in for the Adafruit SSD1306 library. The frame buffer is allocated
+ * and drawn like the real one, and the commands and data go over the Wire
+ * stub with the library's bus clock switching, so they take the bus time.
+ */
+class Adafruit_SSD1306 : public Adafruit_GFX
+{
+private:
+  TwoWire *wire;
+  uint8_t *buffer = nullptr;
+  uint8_t i2caddr = 0;
+  uint32_t wireClk;    // Bus clock during the library's transfers
+  uint32_t restoreClk; // Bus clock after them
+
+  // Sends command bytes in one transaction.
+  void commands(const uint8_t *c, uint8_t n)
+  {
+    wire->setClock(wireClk);
+    wire->beginTransmission(i2caddr);
+    wire->write(static_cast<uint8_t>(0x00));
+    wire->write(c, n);
+    wire->endTransmission();
+    wire->setClock(restoreClk);
+  }
+
+public:
+  static inline uint16_t begins = 0;  // begin() calls
+  static inline uint16_t frames = 0;  // display() calls
+  static inline bool on = false;      // Panel switched on
+
+  Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi, int8_t rst_pin = -1,
+                   uint32_t clkDuring = 400000UL, uint32_t clkAfter = 100000UL)
+      : Adafruit_GFX(w, h), wire(twi), wireClk(clkDuring), restoreClk(clkAfter)
+  {
+    (void)rst_pin;
+  }
+
+  bool begin(uint8_t vcs = SSD1306_SWITCHCAPVCC, uint8_t addr = 0, bool reset = true, bool periphBegin = true)
+  {
+    (void)vcs;
+    (void)reset;
+    if (!buffer && !(buffer = static_cast<uint8_t *>(malloc(_width * ((_height + 7) / 8)))))
+      return false;
+    clearDisplay();
+    if (periphBegin)
+      wire->begin();
+    i2caddr = addr;
+
+    uint8_t init[SSD1306_INIT_COMMANDS];
+    memset(init, 0, sizeof(init));
+    init[SSD1306_INIT_COMMANDS - 1] = SSD1306_DISPLAYON;
+    commands(init, sizeof(init));
+    on = true;
+    begins++;
+    return true;
+  }
+
+  void ssd1306_command(uint8_t c)
+  {
+    commands(&c, 1);
+    if (c == SSD1306_DISPLAYOFF || c == SSD1306_DISPLAYON)
+      on = c == SSD1306_DISPLAYON;
+  }
+
+  void display()
+  {
+    const uint8_t window[] = {SSD1306_PAGEADDR, 0, 0xFF, SSD1306_COLUMNADDR, 0, static_cast<uint8_t>(_width - 1)};
+    commands(window, sizeof(window));
+    wire->setClock(wireClk);
+    uint16_t n = _width * ((_height + 7) / 8);
+    for (uint16_t i = 0; i < n; i += BUFFER_LENGTH - 1)
+    {
+      wire->beginTransmission(i2caddr);
+      wire->write(static_cast<uint8_t>(0x40));
+      wire->write(buffer + i, n - i < BUFFER_LENGTH - 1 ? n - i : BUFFER_LENGTH - 1);
+      wire->endTransmission();
+    }
+    wire->setClock(restoreClk);
+    frames++;
+  }
+
+  void clearDisplay()
+  {
+    memset(buffer, 0, _width * ((_height + 7) / 8));
+#ifndef __AVR__
+    clearRows();
+#endif
+  }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override
+  {
+    if (!buffer || x < 0 || x >= _width || y < 0 || y >= _height)
+      return;
+    uint8_t &b = buffer[x + (y / 8) * _width];
+    uint8_t bit = 1 << (y & 7);
+    if (color == SSD1306_WHITE)
+      b |= bit;
+    else if (color == SSD1306_BLACK)
+      b &= ~bit;
+    else
+      b ^= bit;
+  }
+
+  uint8_t *getBuffer() { return buffer; }
+};
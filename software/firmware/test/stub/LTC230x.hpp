@@ -0,0 +1,129 @@
+#pragma once
+
+#include <Wire.h>
+#include "sim.h"
+
+#define LTC230X_CONVERSION_US 2 // Conversion time, 1.6 us
+
+/**
+ * Stand-in for the ltc230x library driving the LTC2309 over the Wire stub.
+ * Each read is a configuration write and a two byte read on the bus, like the
+ * real one, and returns the 12-bit code set in codes[] for the channel,
+ * left-aligned in 16 bits. A failed transaction returns 0.
+ *
+ * With noise set, each read adds triangular noise of up to that many codes
+ * from a fixed pseudo-random sequence to the code plus fraction[] sixteenths,
+ * and rounds to the nearest code like the converter, so averaging can resolve
+ * the fraction.
+ */
+namespace ltc230x
+{
+  namespace channel
+  {
+    enum Channel : uint8_t
+    {
+      POSITIVE_0_NEGATIVE_COM,
+      POSITIVE_1_NEGATIVE_COM,
+      POSITIVE_2_NEGATIVE_COM,
+      POSITIVE_3_NEGATIVE_COM,
+      POSITIVE_4_NEGATIVE_COM,
+      POSITIVE_5_NEGATIVE_COM,
+      POSITIVE_6_NEGATIVE_COM,
+      POSITIVE_7_NEGATIVE_COM
+    };
+  }
+
+  namespace address
+  {
+    enum Address : uint8_t
+    {
+      AD1_LOW_AD0_LOW = 0x08,
+      AD1_LOW_AD0_FLOAT = 0x09,
+      AD1_LOW_AD0_HIGH = 0x0A,
+      AD1_FLOAT_AD0_HIGH = 0x0B,
+      AD1_HIGH_AD0_FLOAT = 0x18,
+      AD1_HIGH_AD0_LOW = 0x19,
+      AD1_HIGH_AD0_HIGH = 0x1A,
+      AD1_FLOAT_AD0_LOW = 0x1B,
+      AD1_FLOAT_AD0_FLOAT = 0x28
+    };
+  }
+
+  namespace uni_bi
+  {
+    enum Mode : uint8_t
+    {
+      UNIPOLAR,
+      BIPOLAR
+    };
+  }
+
+  namespace sleep
+  {
+    enum Sleep : uint8_t
+    {
+      WAKE,
+      SLEEP
+    };
+  }
+
+  class LTC230x
+  {
+  private:
+    TwoWire *wire = nullptr;
+    uint8_t addr = 0;
+    channel::Channel ch = channel::POSITIVE_0_NEGATIVE_COM;
+    sleep::Sleep sleepMode = sleep::WAKE;
+
+  public:
+    static inline uint16_t codes[8] = {};   // 12-bit code of each channel
+    static inline uint8_t fraction[8] = {}; // Sixteenths of a code added to each channel
+    static inline uint8_t noise = 0;        // Peak noise of each read in codes
+    static inline uint32_t noiseSeed = 1;   // State of the noise sequence
+    static inline uint32_t reads = 0;       // Successful reads of all instances
+
+    // Returns a uniform draw of -8 * noise to 8 * noise sixteenths.
+    static int32_t draw()
+    {
+      noiseSeed = noiseSeed * 1664525UL + 1013904223UL;
+      return static_cast<int32_t>((noiseSeed >> 8) % (16 * noise + 1)) - 8 * noise;
+    }
+
+    // Returns the code of a channel with the noise, rounded to the nearest.
+    static uint16_t sample(uint8_t c)
+    {
+      int32_t v = codes[c] * 16 + fraction[c];
+      if (noise != 0)
+        v += draw() + draw();
+      v = (v + 8) / 16;
+      return v < 0 ? 0 : v > 4095 ? 4095 : v;
+    }
+
+    void begin(TwoWire &w, address::Address a)
+    {
+      wire = &w;
+      addr = a;
+    }
+
+    void set_channel(channel::Channel c) { ch = c; }
+    void set_unipolar_bipolar_mode(uni_bi::Mode) {}
+    void set_sleep_mode(sleep::Sleep s) { sleepMode = s; }
+
+    uint16_t read_raw()
+    {
+      if (!wire)
+        return 0;
+      wire->beginTransmission(addr);
+      wire->write(static_cast<uint8_t>(ch << 4 | sleepMode << 2));
+      if (wire->endTransmission() != 0)
+        return 0;
+      simSpend(LTC230X_CONVERSION_US);
+      if (wire->requestFrom(addr, static_cast<uint8_t>(2)) != 2)
+        return 0;
+      wire->read();
+      wire->read();
+      reads++;
+      return sleepMode == sleep::SLEEP ? 0 : sample(ch) << 4;
+    }
+  };
+}
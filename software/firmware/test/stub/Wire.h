@@ -0,0 +1,159 @@
+#pragma once
+
+#include <Arduino.h>
+#include "sim.h"
+
+#define BUFFER_LENGTH 32
+#define WIRE_HAS_TIMEOUT
+#define WIRE_HANG_US 1000000UL // Time a stalled transaction takes with no timeout set
+
+/**
+ * @brief Stand-in for the Arduino Wire library with an ideal bus.
+ *
+ * Every transaction is acknowledged and takes the bus time of its address and
+ * data bytes at the set clock; reads return zeros, the device stubs supply
+ * their own data. The buffers are sized like the library's, so the free SRAM
+ * measured by the benchmark matches the real build.
+ *
+ * Faults can be injected for the bus recovery tests: each stall makes one
+ * transaction hang until the timeout, which sets the timeout flag and returns
+ * error 5 like the library; each nak makes one transaction unacknowledged,
+ * error 2. The counters tell what the firmware did about it.
+ */
+class TwoWire : public Stream
+{
+private:
+  uint8_t txAddress = 0;
+  uint8_t txLength = 0;
+  uint8_t txBuffer[BUFFER_LENGTH];
+  uint8_t rxIndex = 0;
+  uint8_t rxLength = 0;
+  uint8_t rxBuffer[BUFFER_LENGTH];
+  uint8_t twiBuffers[3 * BUFFER_LENGTH]; // The twi.c buffers, for the SRAM use only
+  uint32_t timeoutUs = 0;
+  bool timeoutFlag = false;
+
+  // Runs one transaction with n data bytes, returns the Wire error code.
+  uint8_t transfer(uint8_t n)
+  {
+    transactions++;
+    if (stalls > 0)
+    {
+      stalls--;
+      timeouts++;
+      simSpend(timeoutUs ? timeoutUs : WIRE_HANG_US);
+      if (timeoutUs)
+        timeoutFlag = true;
+      return 5;
+    }
+    if (naks > 0)
+    {
+      naks--;
+      simSpend(busTime(0));
+      return 2;
+    }
+    simSpend(busTime(n));
+    bytes += n;
+    return 0;
+  }
+
+  // Start, address and n data bytes with their acknowledge bits, and stop.
+  uint32_t busTime(uint8_t n)
+  {
+    return ((n + 1) * 9UL + 2) * 1000000UL / clock;
+  }
+
+public:
+  uint32_t clock = 100000;   // Bus clock in Hz
+  bool active = false;       // Between begin() and end()
+  uint16_t stalls = 0;       // Transactions still to stall
+  uint16_t naks = 0;         // Transactions still to leave unacknowledged
+  uint16_t begins = 0;       // begin() calls
+  uint16_t ends = 0;         // end() calls
+  uint32_t transactions = 0; // Transactions started
+  uint32_t timeouts = 0;     // Transactions stalled
+  uint32_t bytes = 0;        // Data bytes transferred
+
+  void begin()
+  {
+    active = true;
+    begins++;
+  }
+
+  void end()
+  {
+    active = false;
+    ends++;
+  }
+
+  void setClock(uint32_t hz) { clock = hz; }
+
+  void setWireTimeout(uint32_t us = 25000, bool reset = false)
+  {
+    (void)reset;
+    timeoutUs = us;
+  }
+
+  bool getWireTimeoutFlag() { return timeoutFlag; }
+  void clearWireTimeoutFlag() { timeoutFlag = false; }
+
+  void beginTransmission(uint8_t address)
+  {
+    txAddress = address;
+    txLength = 0;
+  }
+
+  void beginTransmission(int address) { beginTransmission(static_cast<uint8_t>(address)); }
+
+  uint8_t endTransmission(bool stop = true)
+  {
+    (void)stop;
+    return transfer(txLength);
+  }
+
+  uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t stop = true)
+  {
+    (void)address;
+    (void)stop;
+    if (quantity > BUFFER_LENGTH)
+      quantity = BUFFER_LENGTH;
+    rxIndex = 0;
+    rxLength = 0;
+    if (transfer(quantity) != 0)
+      return 0;
+    memset(rxBuffer, 0, quantity);
+    rxLength = quantity;
+    return quantity;
+  }
+
+  uint8_t requestFrom(int address, int quantity) { return requestFrom(static_cast<uint8_t>(address), static_cast<uint8_t>(quantity)); }
+
+  size_t write(uint8_t data) override
+  {
+    if (txLength >= BUFFER_LENGTH)
+      return 0;
+    txBuffer[txLength++] = data;
+    return 1;
+  }
+
+  size_t write(const uint8_t *data, size_t quantity) override
+  {
+    size_t n = 0;
+    while (n < quantity && write(data[n]))
+      n++;
+    return n;
+  }
+
+  size_t write(unsigned long n) { return write(static_cast<uint8_t>(n)); }
+  size_t write(long n) { return write(static_cast<uint8_t>(n)); }
+  size_t write(unsigned int n) { return write(static_cast<uint8_t>(n)); }
+  size_t write(int n) { return write(static_cast<uint8_t>(n)); }
+  using Print::write;
+
+  int available() override { return rxLength - rxIndex; }
+  int read() override { return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1; }
+  int peek() override { return rxIndex < rxLength ? rxBuffer[rxIndex] : -1; }
+  void flush() override {}
+};
+
+inline TwoWire Wire;
@@ -0,0 +1,381 @@
+#pragma once
+
+// Host stand-in for the Arduino core of the ATmega328P, for the native tests.
+//
+// Time is simulated: it advances only in delays, sleeps, analogRead(), the
+// serial transmitter and the device time the stubs spend through simSpend(),
+// so every run is exact and repeatable. A callback can be scheduled to run
+// at a simulated time, in the middle of whatever the firmware is doing.
+//
+// The pins keep their mode and PORT latch like the AVR: INPUT clears the
+// latch, INPUT_PULLUP sets it and OUTPUT drives it. simDrivenHigh counts the
+// times each pin started driving high, for catching push-pull drive of open
+// drain lines.
+//
+// Serial models the 64 byte transmit buffer drained at the baud rate, so a
+// full buffer blocks, and keeps what was sent in an output buffer for the
+// tests. Input is injected with Serial.inject() and arrives at the baud
+// rate, one byte after the other from the time of the call.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+#define SDA 18
+#define SCL 19
+#define NUM_DIGITAL_PINS 22
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define F_CPU 16000000L
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define SERIAL_TX_BUFFER_SIZE 64
+#define SERIAL_RX_BUFFER_SIZE 64
+#define ANALOG_READ_US 112 // One conversion at the core's 125 kHz ADC clock
+
+// MCU status register, reset cause flags
+inline volatile uint8_t MCUSR = 0;
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+
+// Heap bounds of avr-libc, see ram.h. The host has no SRAM limit, so the free
+// memory measured comes out as its maximum.
+inline char *__brkval = nullptr;
+inline char __heap_start = 0;
+
+// ---- Simulated time ----
+
+inline uint64_t simNs = 0;              // Time since power-up in ns
+inline uint64_t simEventNs = 0;         // Time of the scheduled callback
+inline void (*simEvent)() = nullptr;    // Scheduled callback, run once
+
+// Advances the clock, running the scheduled callback on the way.
+inline void simAdvanceNs(uint64_t ns)
+{
+  uint64_t end = simNs + ns;
+  while (simEvent && simEventNs <= end)
+  {
+    if (simEventNs > simNs)
+      simNs = simEventNs;
+    void (*event)() = simEvent;
+    simEvent = nullptr;
+    event();
+  }
+  simNs = end;
+}
+
+// Spends device time, see test/stub/sim.h.
+inline void simSpend(uint32_t us) { simAdvanceNs(us * 1000ULL); }
+
+// Schedules a callback at a time in us since power-up.
+inline void simAt(uint64_t us, void (*event)())
+{
+  simEventNs = us * 1000ULL;
+  simEvent = event;
+}
+
+// Time since power-up in us, not wrapping.
+inline uint64_t simMicros() { return simNs / 1000; }
+
+inline unsigned long micros() { return static_cast<uint32_t>(simNs / 1000); }
+inline unsigned long millis() { return static_cast<uint32_t>(simNs / 1000000); }
+inline void delay(unsigned long ms) { simAdvanceNs(ms * 1000000ULL); }
+inline void delayMicroseconds(unsigned int us) { simAdvanceNs(us * 1000ULL); }
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline void yield() {}
+
+// ---- Pins ----
+
+inline uint8_t simDdr[NUM_DIGITAL_PINS] = {};        // 1 = output
+inline uint8_t simPort[NUM_DIGITAL_PINS] = {};       // Output level or pull-up
+inline uint8_t simPulledLow[NUM_DIGITAL_PINS] = {};  // Input held low from outside
+inline bool simHigh[NUM_DIGITAL_PINS] = {};          // Driving high now
+inline uint16_t simDrivenHigh[NUM_DIGITAL_PINS] = {}; // Times a pin started driving high
+inline uint64_t simHighNs[NUM_DIGITAL_PINS] = {};    // Time a pin last started driving high
+inline uint16_t simAnalog[NUM_DIGITAL_PINS] = {};    // analogRead() value of each pin
+inline void (*simPinChange)(uint8_t pin) = nullptr;  // Called after every mode or level change
+
+inline void simPinUpdate(uint8_t pin)
+{
+  bool high = simDdr[pin] && simPort[pin];
+  if (high && !simHigh[pin])
+  {
+    simDrivenHigh[pin]++;
+    simHighNs[pin] = simNs;
+  }
+  simHigh[pin] = high;
+  if (simPinChange)
+    simPinChange(pin);
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin >= NUM_DIGITAL_PINS)
+    return;
+  if (mode == OUTPUT)
+    simDdr[pin] = 1;
+  else
+  {
+    simDdr[pin] = 0;
+    simPort[pin] = mode == INPUT_PULLUP;
+  }
+  simPinUpdate(pin);
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t val)
+{
+  if (pin >= NUM_DIGITAL_PINS)
+    return;
+  simPort[pin] = val != LOW;
+  simPinUpdate(pin);
+}
+
+// Reads the driven level of an output, else HIGH unless held low from outside.
+inline int digitalRead(uint8_t pin)
+{
+  if (pin >= NUM_DIGITAL_PINS)
+    return LOW;
+  if (simDdr[pin])
+    return simPort[pin] ? HIGH : LOW;
+  return simPulledLow[pin] ? LOW : HIGH;
+}
+
+inline int analogRead(uint8_t pin)
+{
+  simSpend(ANALOG_READ_US);
+  return pin < NUM_DIGITAL_PINS ? simAnalog[pin] : 0;
+}
+
+// ---- Print and Serial ----
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+class Print
+{
+private:
+  size_t printNumber(unsigned long n, uint8_t base)
+  {
+    char buf[8 * sizeof(long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+    *str = '\0';
+    if (base < 2)
+      base = 10;
+    do
+    {
+      char c = n % base;
+      n /= base;
+      *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(str);
+  }
+
+  size_t printSigned(long n, int base)
+  {
+    if (base == 10 && n < 0)
+      return print('-') + printNumber(-static_cast<unsigned long>(n), 10);
+    return printNumber(n, base);
+  }
+
+  size_t printFloat(double number, uint8_t digits)
+  {
+    if (isnan(number))
+      return print("nan");
+    if (isinf(number))
+      return print("inf");
+    if (number > 4294967040.0 || number < -4294967040.0)
+      return print("ovf");
+
+    // The steps of the Arduino core, which the display text must match
+    size_t n = 0;
+    if (number < 0.0)
+    {
+      n += print('-');
+      number = -number;
+    }
+    double rounding = 0.5;
+    for (uint8_t i = 0; i < digits; ++i)
+      rounding /= 10.0;
+    number += rounding;
+
+    unsigned long intPart = static_cast<unsigned long>(number);
+    double remainder = number - static_cast<double>(intPart);
+    n += print(intPart);
+    if (digits > 0)
+      n += print('.');
+    while (digits-- > 0)
+    {
+      remainder *= 10.0;
+      unsigned int toPrint = static_cast<unsigned int>(remainder);
+      n += print(toPrint);
+      remainder -= toPrint;
+    }
+    return n;
+  }
+
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  size_t write(const char *str) { return str ? write(reinterpret_cast<const uint8_t *>(str), strlen(str)) : 0; }
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t n = 0;
+    while (size--)
+    {
+      if (!write(*buffer++))
+        break;
+      n++;
+    }
+    return n;
+  }
+  size_t write(const char *buffer, size_t size) { return write(reinterpret_cast<const uint8_t *>(buffer), size); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const __FlashStringHelper *s) { return write(reinterpret_cast<const char *>(s)); }
+  size_t print(const char s[]) { return write(s); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(unsigned char n, int base = DEC) { return printNumber(n, base); }
+  size_t print(int n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned int n, int base = DEC) { return printNumber(n, base); }
+  size_t print(long n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned long n, int base = DEC) { return printNumber(n, base); }
+  size_t print(double n, int digits = 2) { return printFloat(n, digits); }
+
+  size_t println() { return write("\r\n"); }
+  template <class T>
+  size_t println(T value) { return print(value) + println(); }
+  template <class T>
+  size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+class HardwareSerial : public Stream
+{
+private:
+  uint64_t txDoneNs = 0; // Time the last queued byte has been sent
+  char in[256];          // Injected input
+  uint64_t inNs[256];    // Time each input byte has been received
+  size_t inHead = 0;
+  size_t inTail = 0;
+
+  uint64_t byteNs() const { return 10000000000ULL / baud; }
+
+  // Bytes still in the transmit buffer.
+  uint16_t queued() const
+  {
+    if (txDoneNs <= simNs)
+      return 0;
+    return (txDoneNs - simNs + byteNs() - 1) / byteNs();
+  }
+
+public:
+  unsigned long baud = 9600; // Rate set by begin()
+  char *out = nullptr;       // Everything sent, terminated
+  size_t outLength = 0;
+  size_t outCapacity = 0;
+
+  void begin(unsigned long rate) { baud = rate; }
+  void begin(unsigned long rate, uint8_t) { baud = rate; }
+  void end() {}
+  operator bool() { return true; }
+
+  int available() override
+  {
+    size_t n = inHead;
+    while (n < inTail && inNs[n] <= simNs)
+      n++;
+    return n - inHead;
+  }
+  int peek() override { return available() > 0 ? in[inHead] : -1; }
+  int read() override { return available() > 0 ? in[inHead++] : -1; }
+
+  int availableForWrite() override { return SERIAL_TX_BUFFER_SIZE - 1 - queued(); }
+
+  void flush() override
+  {
+    if (txDoneNs > simNs)
+      simAdvanceNs(txDoneNs - simNs);
+  }
+
+  size_t write(uint8_t c) override
+  {
+    while (availableForWrite() <= 0)
+      simAdvanceNs(byteNs()); // Blocks until the UART has sent a byte
+    txDoneNs = (txDoneNs > simNs ? txDoneNs : simNs) + byteNs();
+
+    if (outLength + 2 > outCapacity)
+    {
+      outCapacity = outCapacity ? 2 * outCapacity : 4096;
+      out = static_cast<char *>(realloc(out, outCapacity));
+    }
+    out[outLength++] = c;
+    out[outLength] = '\0';
+    return 1;
+  }
+  using Print::write;
+
+  // Queues input for the firmware to read, sent by the host from now on.
+  void inject(const char *s)
+  {
+    if (inHead == inTail)
+      inHead = inTail = 0;
+    uint64_t ns = inHead < inTail && inNs[inTail - 1] > simNs ? inNs[inTail - 1] : simNs;
+    while (*s && inTail < sizeof(in))
+    {
+      ns += byteNs();
+      inNs[inTail] = ns;
+      in[inTail++] = *s++;
+    }
+  }
+
+  // Forgets the output sent so far.
+  void clearOutput()
+  {
+    outLength = 0;
+    if (out)
+      out[0] = '\0';
+  }
+
+  // Returns the output sent so far, never null.
+  const char *output() const { return out ? out : ""; }
+};
+
+inline HardwareSerial Serial;
@@ -0,0 +1,86 @@
+#pragma once
+
+// Host stand-in of the part of ArduinoJson 6 the firmware uses: a flat object
+// of keys and scalar values, serialized in insertion order.
+
+#include <Arduino.h>
+
+#define JSON_OBJECT_SIZE(n) ((n) * 16)
+#define JSON_STUB_MEMBERS 12
+#define JSON_STUB_VALUE 32
+
+// Text inserted as is, see serialized().
+struct SerializedValue
+{
+  const char *text;
+};
+
+inline SerializedValue serialized(const char *text) { return SerializedValue{text}; }
+
+template <size_t Capacity>
+class StaticJsonDocument
+{
+private:
+  struct Member
+  {
+    const char *key;
+    char value[JSON_STUB_VALUE];
+  };
+  Member members[JSON_STUB_MEMBERS];
+  uint8_t used = 0;
+
+  char *slot(const char *key)
+  {
+    for (uint8_t i = 0; i < used; i++)
+    {
+      if (strcmp(members[i].key, key) == 0)
+        return members[i].value;
+    }
+    if (used == JSON_STUB_MEMBERS)
+      abort();
+    members[used].key = key;
+    return members[used++].value;
+  }
+
+public:
+  class Ref
+  {
+  private:
+    char *value;
+
+  public:
+    explicit Ref(char *v) : value(v) {}
+    void operator=(SerializedValue v) { snprintf(value, JSON_STUB_VALUE, "%s", v.text); }
+    void operator=(const char *v) { snprintf(value, JSON_STUB_VALUE, "\"%s\"", v); }
+    void operator=(bool v) { snprintf(value, JSON_STUB_VALUE, "%s", v ? "true" : "false"); }
+    void operator=(int v) { snprintf(value, JSON_STUB_VALUE, "%d", v); }
+    void operator=(unsigned int v) { snprintf(value, JSON_STUB_VALUE, "%u", v); }
+    void operator=(long v) { snprintf(value, JSON_STUB_VALUE, "%ld", v); }
+    void operator=(unsigned long v) { snprintf(value, JSON_STUB_VALUE, "%lu", v); }
+    void operator=(double v) { snprintf(value, JSON_STUB_VALUE, "%.9g", v); }
+  };
+
+  Ref operator[](const char *key) { return Ref(slot(key)); }
+  Ref operator[](const __FlashStringHelper *key) { return Ref(slot(reinterpret_cast<const char *>(key))); }
+
+  void clear() { used = 0; }
+
+  // Prints the object, or only counts its length without an output.
+  size_t print(Print *out) const
+  {
+    char text[JSON_STUB_MEMBERS * (JSON_STUB_VALUE + 16) + 3];
+    size_t n = 0;
+    text[n++] = '{';
+    for (uint8_t i = 0; i < used; i++)
+      n += snprintf(text + n, sizeof(text) - n, "%s\"%s\":%s", i ? "," : "", members[i].key, members[i].value);
+    text[n++] = '}';
+    text[n] = '\0';
+    return out ? out->write(text) : n;
+  }
+};
+
+template <size_t Capacity>
+size_t serializeJson(const StaticJsonDocument<Capacity> &doc, Print &out) { return doc.print(&out); }
+
+template <size_t Capacity>
+size_t measureJson(const StaticJsonDocument<Capacity> &doc) { return doc.print(nullptr); }
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Host stand-in of the Encoder library: the count is set by the test.
+class Encoder
+{
+public:
+  static inline int32_t position = 0; // Count, four per detent
+
+  Encoder(uint8_t, uint8_t) {}
+  int32_t read() { return position; }
+  void write(int32_t p) { position = p; }
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+// Host stand-in of avr-libc's sleep modes. The CPU sleeps until the next
+// Timer0 overflow, which the Arduino core has every 1024 us.
+
+#include <Arduino.h>
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_DOWN 2
+
+#define SLEEP_WAKE_US 1024
+
+inline void set_sleep_mode(uint8_t) {}
+inline void sleep_enable() {}
+inline void sleep_disable() {}
+inline void sleep_cpu() { simSpend(SLEEP_WAKE_US); }
+inline void sleep_mode() { sleep_cpu(); }
@@ -0,0 +1,23 @@
+#pragma once
+
+// Host stand-in of avr-libc's watchdog: keeps the state for the tests.
+
+#include <stdint.h>
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+
+inline int8_t simWatchdog = -1;   // Timeout set, -1 while disabled
+inline uint32_t simWatchdogResets = 0; // wdt_reset() calls
+
+inline void wdt_enable(uint8_t timeout) { simWatchdog = timeout; }
+inline void wdt_disable() { simWatchdog = -1; }
+inline void wdt_reset() { simWatchdogResets++; }
@@ -0,0 +1,20 @@
+#pragma once
+
+// Device time of the stand-ins in this directory. The stubs call simSpend()
+// for the time the real device or bus would take: on the host it advances the
+// simulated clock of native/Arduino.h, in the AVR benchmark it busy-waits, so
+// the cycle counts include it.
+
+#include <Arduino.h>
+
+#ifdef __AVR__
+inline void simSpend(uint32_t us)
+{
+  while (us > 10000)
+  {
+    delayMicroseconds(10000);
+    us -= 10000;
+  }
+  delayMicroseconds(us);
+}
+#endif
@@ -0,0 +1,169 @@
+// Cycle-exact benchmark of the firmware on the simulated ATmega328P.
+//
+// Runs under simavr, see the bench environment in platformio.ini, with the
+// real Arduino core and the I2C devices replaced by the stand-ins in
+// test/stub, which busy-wait for their bus time. Timer1 counts the CPU
+// cycles for the profile. Every screen is shown for BENCH_LOOPS loops with a
+// carrier present and the worst case of each module and of the whole loop is
+// checked against the budgets in profile.h. The free SRAM after start-up and
+// the least stack headroom seen over the run are reported and checked too.
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <unity.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include "model.h"
+#include "enc.h"
+#include "profile.h"
+#include "ram.h"
+
+#define BENCH_LOOPS 64         // Loops timed per screen
+#define BENCH_RSSI 100         // RSSI reading of the carrier
+#define BENCH_FREQ_KHZ 14200   // Carrier frequency
+#define BENCH_FWD_CODE 2000    // Forward detector code, about 35 dBm
+#define BENCH_REF_CODE 1400    // Reflected detector code, below the trip
+#define BENCH_MIN_HEADROOM 32  // Least stack headroom accepted, in bytes
+#define BENCH_PAINT 0xA5       // Fill of the unused stack area
+
+extern Model model;
+extern Profile profile;
+void setup();
+void loop();
+
+static volatile uint16_t overflows = 0; // Timer1 overflows
+static uint16_t ramAfterSetup = 0;      // Free SRAM after setup()
+
+ISR(TIMER1_OVF_vect)
+{
+  overflows++;
+}
+
+// CPU cycles counted by Timer1, the profile clock of this build.
+uint32_t benchCycles()
+{
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t low = TCNT1;
+  uint16_t high = overflows;
+  if ((TIFR1 & _BV(TOV1)) && low < 0x8000)
+    high++; // Overflow not yet serviced
+  SREG = sreg;
+  return static_cast<uint32_t>(high) << 16 | low;
+}
+
+// The carrier's RSSI on A0, after the real conversion for its time.
+extern "C" int __real_analogRead(uint8_t pin);
+extern "C" int __wrap_analogRead(uint8_t pin)
+{
+  int value = __real_analogRead(pin);
+  return pin == A0 ? BENCH_RSSI : value;
+}
+
+// The button is not pressed; simavr does not model the pull-up.
+extern "C" int __real_digitalRead(uint8_t pin);
+extern "C" int __wrap_digitalRead(uint8_t pin)
+{
+  return pin == ENC_BUTTON ? HIGH : __real_digitalRead(pin);
+}
+
+// First free byte above the heap.
+static uint8_t *heapEnd()
+{
+  extern char *__brkval;
+  extern char __heap_start;
+  return reinterpret_cast<uint8_t *>(__brkval ? __brkval : &__heap_start);
+}
+
+// Fills the free SRAM below the current stack frame.
+static void paintStack()
+{
+  uint8_t *top = reinterpret_cast<uint8_t *>(SP) - 16;
+  for (uint8_t *p = heapEnd(); p < top; p++)
+    *p = BENCH_PAINT;
+}
+
+// Bytes above the heap the stack has never reached since paintStack().
+static uint16_t headroom()
+{
+  uint8_t *p = heapEnd();
+  uint16_t n = 0;
+  while (p[n] == BENCH_PAINT)
+    n++;
+  return n;
+}
+
+void setUp() {}
+void tearDown() {}
+
+// Times BENCH_LOOPS loops on a screen and checks the budgets.
+static void bench(Screen scr)
+{
+  model.scr = scr;
+  profile.init();
+  for (uint16_t i = 0; i < BENCH_LOOPS; i++)
+    loop();
+
+  char name[40];
+  for (uint8_t slot = 0; slot < PROF_SLOTS; slot++)
+  {
+    if (profile.runs(slot) == 0)
+      continue;
+    snprintf(name, sizeof(name), "slot %u: %lu cycles", slot, static_cast<unsigned long>(profile.cycles(slot)));
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(profile.budget(slot), profile.cycles(slot), name);
+  }
+  TEST_ASSERT_EQUAL(BENCH_LOOPS, profile.runs(PROF_LOOP + scr));
+  TEST_ASSERT_EQUAL(0, profile.print());
+}
+
+void test_main_screen() { bench(MAIN); }
+void test_info_screen() { bench(INFO); }
+void test_dbm_screen() { bench(DBM); }
+void test_raw_screen() { bench(RAW); }
+void test_trend_screen() { bench(TREND); }
+void test_scan_screen() { bench(SCAN); }
+
+void test_ram()
+{
+  char message[48];
+  snprintf(message, sizeof(message), "free %u, history %u, headroom %u",
+           ramAfterSetup, model.histLen, headroom());
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL(HISTORY_LEN, model.histLen);
+  TEST_ASSERT_GREATER_OR_EQUAL(BENCH_MIN_HEADROOM, headroom());
+}
+
+int main()
+{
+  init();
+
+  // Timer1 counts every CPU cycle
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TIMSK1 = _BV(TOIE1);
+
+  ltc230x::LTC230x::codes[0] = BENCH_FWD_CODE;
+  ltc230x::LTC230x::codes[1] = BENCH_REF_CODE;
+  FreqCount.count = BENCH_FREQ_KHZ * 5L;
+  setup();
+  ramAfterSetup = freeRam();
+  loop(); // The encoder selects its screen on the first loop
+  paintStack();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_main_screen);
+  RUN_TEST(test_info_screen);
+  RUN_TEST(test_dbm_screen);
+  RUN_TEST(test_raw_screen);
+  RUN_TEST(test_trend_screen);
+  RUN_TEST(test_scan_screen);
+  RUN_TEST(test_ram);
+  UNITY_END();
+
+  // simavr exits when the CPU sleeps with the interrupts off
+  Serial.flush();
+  cli();
+  sleep_enable();
+  sleep_cpu();
+  return 0;
+}
@@ -0,0 +1,51 @@
+// First frame after boot.
+//
+// Before the first reading the main screen must show its value fields
+// blank, as after a clear, not values derived from uninitialised powers.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <Adafruit_GFX.h>
+#include <string.h>
+#include "model.h"
+
+extern Model model;
+void setup();
+void loop();
+
+void setUp() {}
+void tearDown() {}
+
+// Checks that a text row holds the label and nothing after it but spaces.
+static void assertBlank(uint8_t row, const char *label)
+{
+  const char *text = Adafruit_GFX::rows[row];
+  TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE(label, text, strlen(label), text);
+  for (const char *c = text + strlen(label); *c != '\0'; c++)
+    TEST_ASSERT_EQUAL_CHAR_MESSAGE(' ', *c, text);
+}
+
+// The first frame shows blank power, SWR, return loss and loss fields.
+void test_first_frame_blank()
+{
+  TEST_ASSERT_EQUAL(MAIN, model.scr);
+#if PORT_COUNT == 1
+  assertBlank(0, "FWD __: ");
+#endif
+  assertBlank(1, "SWR __: ");
+  assertBlank(2, "RL ___: ");
+  assertBlank(3, "LOSS _: ");
+  TEST_ASSERT_EQUAL(0, model.fwdw());
+  TEST_ASSERT_EQUAL(0, model.swr());
+}
+
+int main()
+{
+  setup();
+  Adafruit_GFX::clearRows();
+  loop();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_first_frame_blank);
+  return UNITY_END();
+}
@@ -0,0 +1,161 @@
+// I2C bus recovery with injected faults.
+//
+// A stalled transaction must set the timeout flag and be recovered: the
+// error counted against the device that used the bus, Wire restarted at
+// the I2C clock, the device set up again and the counters reported. The
+// recovery must clock a stuck SDA free and must never drive SDA or SCL
+// high, they are open drain lines.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <Wire.h>
+#include <Adafruit_SSD1306.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include <string.h>
+#include "debug.h"
+#include "model.h"
+#include "display.h"
+#include "bus.h"
+
+#define FREQ_KHZ 14200
+#define FWD_CODE 2000 // Forward detector code of the carrier
+#define REF_CODE 1400 // Reflected detector code of the carrier
+#define STUCK_PULSES 3 // SCL pulses until the stuck device lets go of SDA
+
+extern Model model;
+extern Display disp;
+extern Bus bus;
+void setup();
+void loop();
+
+static uint16_t sclPulses; // SCL pulled low during a recovery
+static uint16_t errors[BUS_DEVICES];
+static uint16_t recoveries;
+static uint16_t wireBegins;
+static uint16_t wireEnds;
+static uint16_t displayBegins;
+
+// Takes the counters before a fault and clears the drive counts.
+void setUp()
+{
+  memcpy(errors, model.busErrors, sizeof(errors));
+  recoveries = model.busRecoveries;
+  wireBegins = Wire.begins;
+  wireEnds = Wire.ends;
+  displayBegins = Adafruit_SSD1306::begins;
+  simDrivenHigh[SDA] = 0;
+  simDrivenHigh[SCL] = 0;
+  Serial.clearOutput();
+}
+
+void tearDown()
+{
+  simPinChange = nullptr;
+  simPulledLow[SDA] = 0;
+}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Checks that one recovery was made for dev and left the bus working.
+static void assertRecovered(BusDevice dev)
+{
+  TEST_ASSERT_FALSE(Wire.getWireTimeoutFlag());
+  TEST_ASSERT_EQUAL(errors[dev] + 1, model.busErrors[dev]);
+  TEST_ASSERT_EQUAL(errors[1 - dev], model.busErrors[1 - dev]);
+  TEST_ASSERT_EQUAL(recoveries + 1, model.busRecoveries);
+  TEST_ASSERT_EQUAL(wireEnds + 1, Wire.ends);
+  TEST_ASSERT_EQUAL(wireBegins + 1, Wire.begins);
+  TEST_ASSERT_TRUE(Wire.active);
+  TEST_ASSERT_EQUAL(I2C_CLOCK_HZ, Wire.clock);
+  TEST_ASSERT_EQUAL(0, simDrivenHigh[SDA]);
+  TEST_ASSERT_EQUAL(0, simDrivenHigh[SCL]);
+  TEST_ASSERT_NOT_NULL(strstr(Serial.output(), "{\"bus\":"));
+}
+
+// A stalled ADC transaction is blamed on the ADC and the bus recovered.
+void test_adc_stall_recovered()
+{
+  uint64_t sample = model.sampleTime;
+  Wire.stalls = 1;
+  loop();
+  TEST_ASSERT_EQUAL(0, Wire.stalls);
+  assertRecovered(BUS_ADC);
+  TEST_ASSERT_EQUAL(displayBegins, Adafruit_SSD1306::begins);
+  TEST_ASSERT_EQUAL(sample, model.sampleTime); // The reading was dropped
+
+  loops(3);
+  TEST_ASSERT_EQUAL(recoveries + 1, model.busRecoveries);
+  TEST_ASSERT_NOT_EQUAL(sample, model.sampleTime);
+}
+
+// A stalled display transaction is blamed on the display, which is set up again.
+void test_display_stall_recovered()
+{
+  Wire.stalls = 1;
+  disp.loop();
+  bus.check(BUS_DISP);
+  assertRecovered(BUS_DISP);
+  TEST_ASSERT_EQUAL(displayBegins + 1, Adafruit_SSD1306::begins);
+  TEST_ASSERT_TRUE(Adafruit_SSD1306::on);
+
+  loops(3);
+  TEST_ASSERT_EQUAL(recoveries + 1, model.busRecoveries);
+}
+
+// Plays a device holding SDA low until it has seen STUCK_PULSES clocks.
+static void stuckDevice(uint8_t pin)
+{
+  if (pin == SCL && simDdr[SCL] && !simPort[SCL] && ++sclPulses >= STUCK_PULSES)
+    simPulledLow[SDA] = 0;
+}
+
+// SDA held low is clocked free, then the STOP is sent.
+void test_stuck_sda_clocked_free()
+{
+  sclPulses = 0;
+  simPulledLow[SDA] = 1;
+  simPinChange = stuckDevice;
+  Wire.stalls = 1;
+  loop();
+  assertRecovered(BUS_ADC);
+  TEST_ASSERT_EQUAL(0, simPulledLow[SDA]);
+  TEST_ASSERT_EQUAL(STUCK_PULSES + 1, sclPulses); // The pulses and the STOP
+  TEST_ASSERT_EQUAL(0, simDdr[SDA]);
+  TEST_ASSERT_EQUAL(0, simDdr[SCL]);
+}
+
+// An unacknowledged transaction is no timeout and needs no recovery.
+void test_nak_not_recovered()
+{
+  Wire.naks = 1;
+  loop();
+  TEST_ASSERT_EQUAL(0, Wire.naks);
+  TEST_ASSERT_FALSE(Wire.getWireTimeoutFlag());
+  TEST_ASSERT_EQUAL(recoveries, model.busRecoveries);
+  TEST_ASSERT_EQUAL(wireEnds, Wire.ends);
+  TEST_ASSERT_NULL(strstr(Serial.output(), "{\"bus\":"));
+}
+
+int main()
+{
+  setup();
+
+  // Carrier, so the ADC is read on every loop
+  simAnalog[A0] = 100;
+  FreqCount.count = FREQ_KHZ * 5L;
+  ltc230x::LTC230x::codes[0] = FWD_CODE;
+  ltc230x::LTC230x::codes[1] = REF_CODE;
+  loops(50);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_adc_stall_recovered);
+  RUN_TEST(test_display_stall_recovered);
+  RUN_TEST(test_stuck_sda_clocked_free);
+  RUN_TEST(test_nak_not_recovered);
+  return UNITY_END();
+}
@@ -0,0 +1,139 @@
+// Command parser and its answers.
+//
+// Malformed, too long and out of range commands must be answered with
+// {"err":"<cmd>"}, counted and leave the settings alone, and the parser
+// must take the next command normally afterwards. The status report must
+// come out one short line per loop pass.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <string.h>
+#include "model.h"
+#include "cmd.h"
+
+extern Model model;
+void setup();
+void loop();
+
+void setUp()
+{
+  Serial.clearOutput();
+}
+
+void tearDown() {}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends a command line and checks that it is answered with the given line.
+static void assertAnswer(const char *line, const char *answer)
+{
+  Serial.clearOutput();
+  uint16_t errors = model.cmdErrors;
+  Serial.inject(line);
+  loops(strlen(line) / CMD_BYTES_PER_PASS + 2);
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(answer, Serial.output(), line);
+  TEST_ASSERT_EQUAL_MESSAGE(errors + (strstr(answer, "err") ? 1 : 0), model.cmdErrors, line);
+}
+
+// Arguments that are not decimal numbers are rejected.
+void test_malformed_rejected()
+{
+  assertAnswer("D1x\n", "{\"err\":\"D\"}\r\n");
+  assertAnswer("Dx\n", "{\"err\":\"D\"}\r\n");
+  assertAnswer("D-1\n", "{\"err\":\"D\"}\r\n");
+  assertAnswer("D 5\n", "{\"err\":\"D\"}\r\n");
+  assertAnswer("D\n", "{\"err\":\"D\"}\r\n");
+  assertAnswer("R1\n", "{\"err\":\"R\"}\r\n");
+  assertAnswer("?1\n", "{\"err\":\"?\"}\r\n");
+  assertAnswer("Q\n", "{\"err\":\"Q\"}\r\n");
+  TEST_ASSERT_EQUAL(1, model.decimation);
+}
+
+// Arguments outside the range of a command are rejected.
+void test_out_of_range_rejected()
+{
+  bool logging = model.logging;
+  assertAnswer("L2\n", "{\"err\":\"L\"}\r\n");
+  assertAnswer("D0\n", "{\"err\":\"D\"}\r\n");
+  assertAnswer("D256\n", "{\"err\":\"D\"}\r\n");
+  assertAnswer("D99999999999\n", "{\"err\":\"D\"}\r\n");
+  assertAnswer("A0\n", "{\"err\":\"A\"}\r\n");
+  assertAnswer("A257\n", "{\"err\":\"A\"}\r\n");
+  assertAnswer("S6\n", "{\"err\":\"S\"}\r\n");
+  assertAnswer("H65536\n", "{\"err\":\"H\"}\r\n");
+  assertAnswer("P10\n", "{\"err\":\"P\"}\r\n");
+  assertAnswer("O4\n", "{\"err\":\"O\"}\r\n");
+  assertAnswer("M0\n", "{\"err\":\"M\"}\r\n");
+  assertAnswer("U115200\n", "{\"err\":\"U\"}\r\n");
+  assertAnswer("K\n", "{\"err\":\"K\"}\r\n");
+  assertAnswer("X1001\n", "{\"err\":\"X\"}\r\n");
+  assertAnswer("Z2\n", "{\"err\":\"Z\"}\r\n");
+  assertAnswer("E3\n", "{\"err\":\"E\"}\r\n");
+  TEST_ASSERT_EQUAL(logging, model.logging);
+  TEST_ASSERT_EQUAL(1, model.decimation);
+  TEST_ASSERT_EQUAL(AWG_WINDOW, model.avgWindow);
+  TEST_ASSERT_EQUAL(MAIN, model.scr);
+  TEST_ASSERT_EQUAL(LOG_SAMPLES, model.logMode);
+}
+
+// A line longer than the buffer is rejected as a whole, and the next is taken.
+void test_too_long_rejected()
+{
+  assertAnswer("D1234567890123456789012345678\n", "{\"err\":\"D\"}\r\n");
+  assertAnswer("T123456789012345678901234\n", "{\"err\":\"T\"}\r\n");
+  TEST_ASSERT_FALSE(model.clockSynced);
+  assertAnswer("D5\n", "{\"ok\":\"D\"}\r\n");
+  TEST_ASSERT_EQUAL(5, model.decimation);
+  assertAnswer("d1\r\n", "{\"ok\":\"D\"}\r\n");
+  TEST_ASSERT_EQUAL(1, model.decimation);
+}
+
+// Empty lines are not answered.
+void test_empty_lines_ignored()
+{
+  assertAnswer("\n\r\n\n", "");
+}
+
+// The status report is sent a line per loop pass, each fitting the transmit buffer.
+void test_status_line_per_pass()
+{
+  Serial.inject("?\n");
+  for (uint8_t i = 0; i < 10 && Serial.output()[0] == '\0'; i++)
+    loop();
+
+  const char *keys[STATUS_LINES] = {"{\"log\":", "{\"scr\":", "{\"sync\":", "{\"swr10\":", "{\"baud\":", "{\"cerr\":"};
+  size_t from = 0;
+  for (uint8_t i = 0; i < STATUS_LINES; i++)
+  {
+    if (i > 0)
+      loop();
+    const char *line = Serial.output() + from;
+    size_t length = strlen(line);
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE(keys[i], line, strlen(keys[i]), line);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("}\r\n", line + length - 3, line);
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(line + length - 1, strchr(line, '\n'), line);
+    TEST_ASSERT_LESS_THAN_MESSAGE(SERIAL_TX_BUFFER_SIZE, length, line);
+    from += length;
+  }
+
+  loops(3);
+  TEST_ASSERT_EQUAL(from, strlen(Serial.output()));
+}
+
+int main()
+{
+  setup();
+  loops(3);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_malformed_rejected);
+  RUN_TEST(test_out_of_range_rejected);
+  RUN_TEST(test_too_long_rejected);
+  RUN_TEST(test_empty_lines_ignored);
+  RUN_TEST(test_status_line_per_pass);
+  return UNITY_END();
+}
@@ -0,0 +1,237 @@
+// Display text formatting matches the print calls it replaced.
+//
+// Line::fixed(), power() and decimal() must give the same text as the
+// display's printFixedWidth() and printPower() and Print::print(double)
+// did, to the last digit, over a sweep of values that includes the unit and
+// decade boundaries. The old functions are kept here as the reference. The
+// host works in 64-bit doubles where the ATmega328P has 32-bit ones, so the
+// sweep checks the steps are the same, not the float rounding of the target.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include "fmt.h"
+
+// Print that collects its text, like the display's buffer did.
+class Text : public Print
+{
+public:
+  char buf[64];
+  uint8_t len = 0;
+
+  size_t write(uint8_t c) override
+  {
+    if (len < sizeof(buf) - 1)
+      buf[len++] = c;
+    buf[len] = '\0';
+    return 1;
+  }
+  using Print::write;
+
+  const char *clear()
+  {
+    len = 0;
+    buf[0] = '\0';
+    return buf;
+  }
+};
+
+static Text d;
+static Line line;
+static uint32_t compared;
+
+void setUp() {}
+void tearDown() {}
+
+// The display's printFixedWidth() before Line, as reference.
+static void printFixedWidth(double number, byte width, byte precision = 2, char filler = ' ')
+{
+  unsigned long integerPart = static_cast<unsigned long>(number);
+  double fractionalPart = number - integerPart;
+  byte digitsPrinted = 0;
+
+  unsigned long temp = integerPart;
+  while (temp > 0)
+  {
+    temp /= 10;
+    digitsPrinted++;
+  }
+
+  if (precision > 0)
+    digitsPrinted += precision + 1;
+
+  while (digitsPrinted < width)
+  {
+    d.print(filler);
+    digitsPrinted++;
+  }
+
+  d.print(integerPart);
+  if (precision > 0)
+  {
+    d.print('.');
+    for (byte i = 0; i < precision; i++)
+    {
+      fractionalPart *= 10;
+      byte digit = static_cast<byte>(fractionalPart);
+      d.print(digit);
+      fractionalPart -= digit;
+    }
+  }
+}
+
+// The display's printPower() before Line, as reference.
+static void printPower(double powW, byte width = 5)
+{
+  if (powW < 1E-12)
+    return;
+  else if (powW < 1E-9)
+  {
+    printFixedWidth(powW * 1E12, width, 1);
+    d.print(F(" pW"));
+  }
+  else if (powW < 1E-6)
+  {
+    printFixedWidth(powW * 1E9, width, 1);
+    d.print(F(" nW"));
+  }
+  else if (powW < 1E-3)
+  {
+    printFixedWidth(powW * 1E6, width, 1);
+    d.print(F(" uW"));
+  }
+  else if (powW < 1)
+  {
+    printFixedWidth(powW * 1E3, width, 1);
+    d.print(F(" mW"));
+  }
+  else if (powW < 1.6E3)
+  {
+    printFixedWidth(powW, width, 1);
+    d.print(F(" W"));
+  }
+  else
+  {
+    printFixedWidth(powW / 1E3, width, 2);
+    d.print(F(" kW"));
+  }
+}
+
+static void assertFixed(double value, uint8_t width, uint8_t precision)
+{
+  d.clear();
+  printFixedWidth(value, width, precision);
+  line.clear().fixed(value, width, precision);
+  char message[64];
+  snprintf(message, sizeof(message), "fixed(%.17g, %u, %u)", value, width, precision);
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(d.buf, line.c_str(), message);
+  compared++;
+}
+
+static void assertPower(double watts)
+{
+  d.clear();
+  printPower(watts);
+  line.clear().power(watts);
+  char message[64];
+  snprintf(message, sizeof(message), "power(%.17g)", watts);
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(d.buf, line.c_str(), message);
+  compared++;
+}
+
+static void assertDecimal(double value, uint8_t precision)
+{
+  d.clear();
+  d.print(value, precision);
+  line.clear().decimal(value, precision);
+  char message[64];
+  snprintf(message, sizeof(message), "decimal(%.17g, %u)", value, precision);
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(d.buf, line.c_str(), message);
+  compared++;
+}
+
+// Values at and just around n * 10^e for the digits that roll over a decade.
+static void aroundBoundaries(void (*check)(double), int minExp, int maxExp)
+{
+  static const double edges[] = {1.0, 1.6, 9.9, 9.95, 9.99, 9.995, 9.999, 9.9995, 9.99999};
+  for (int e = minExp; e <= maxExp; e++)
+    for (double edge : edges)
+    {
+      double v = edge * pow(10.0, e);
+      check(v);
+      check(nextafter(v, 0.0));
+      check(nextafter(v, INFINITY));
+    }
+}
+
+static void swrValue(double v) { assertFixed(v, 5, 1); }
+static void rlValue(double v) { assertFixed(v, 4, 2); }
+static void powerValue(double v) { assertPower(v); }
+static void dbmValue(double v)
+{
+  assertDecimal(v, 1);
+  assertDecimal(-v, 1);
+  assertDecimal(v, 2);
+  assertDecimal(v, 0);
+}
+
+// The SWR and return loss fields of the main screen.
+void test_fixed_matches()
+{
+  compared = 0;
+  for (uint32_t i = 0; i <= 1000000; i += 7)
+    swrValue(i / 1000.0);
+  for (uint32_t i = 0; i <= 70000; i += 3)
+    rlValue(i / 1000.0);
+  aroundBoundaries(swrValue, -2, 6);
+  aroundBoundaries(rlValue, -3, 2);
+  assertFixed(0.0, 5, 1);
+  assertFixed(1E9, 5, 1);
+}
+
+// The power fields from below 1 pW to beyond 1 MW.
+void test_power_matches()
+{
+  for (double e = -13.0; e <= 6.5; e += 0.0001)
+    powerValue(pow(10.0, e));
+  for (uint32_t i = 1; i <= 20000; i++)
+    powerValue(i * 0.1);
+  aroundBoundaries(powerValue, -13, 6);
+  assertPower(0.0);
+}
+
+// The dBm, coupling and directivity fields, which round like Print.
+void test_decimal_matches()
+{
+  for (int32_t i = 0; i <= 2000000; i += 11)
+    dbmValue(i / 10000.0);
+  aroundBoundaries(dbmValue, -3, 5);
+  assertDecimal(0.0, 2);
+
+  char message[40];
+  snprintf(message, sizeof(message), "%lu values compared", static_cast<unsigned long>(compared));
+  TEST_MESSAGE(message);
+}
+
+// A rounded value that rolls over a decade gains its digit and keeps the precision.
+void test_decade_rollover()
+{
+  TEST_ASSERT_EQUAL_STRING("10.0", line.clear().decimal(9.995, 1).c_str());
+  TEST_ASSERT_EQUAL_STRING("-10.0", line.clear().decimal(-9.96, 1).c_str());
+  TEST_ASSERT_EQUAL_STRING("100.00", line.clear().decimal(99.9999, 2).c_str());
+  TEST_ASSERT_EQUAL_STRING("  9.9", line.clear().fixed(9.995, 5, 1).c_str());
+  TEST_ASSERT_EQUAL_STRING("999.9 pW", line.clear().power(9.9999E-10).c_str());
+  TEST_ASSERT_EQUAL_STRING("  1.0 nW", line.clear().power(1.0001E-9).c_str());
+  TEST_ASSERT_EQUAL_STRING(" 1.60 kW", line.clear().power(1.6E3).c_str());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fixed_matches);
+  RUN_TEST(test_power_matches);
+  RUN_TEST(test_decimal_matches);
+  RUN_TEST(test_decade_rollover);
+  return UNITY_END();
+}
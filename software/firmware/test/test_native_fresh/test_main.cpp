@@ -0,0 +1,108 @@
+// Measurement records are only logged for new ADC readings.
+//
+// With a carrier present every loop that reads the ADC logs one record of
+// the new reading. A loop whose ADC reading is dropped because the bus
+// timed out must not log the previous reading again.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <Wire.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include <string.h>
+#include "model.h"
+
+#define FREQ_KHZ 14200
+#define FWD_CODE 2000 // Forward detector code of the carrier
+#define REF_CODE 1400 // Reflected detector code of the carrier
+#define LOOPS 50      // Loops checked per test
+
+extern Model model;
+void setup();
+void loop();
+
+void setUp() {}
+void tearDown() {}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends a command line and runs the loop until it is taken.
+static void command(const char *line)
+{
+  Serial.inject(line);
+  loops(3);
+}
+
+// Returns the number of measurement records in the serial output.
+static uint16_t records()
+{
+  uint16_t n = 0;
+  for (const char *s = Serial.output(); (s = strstr(s, "{\"t\":")) != nullptr; s++)
+    n++;
+  return n;
+}
+
+/**
+ * Runs one loop and checks that it logged a record exactly when it took a
+ * new reading. Returns true if it did.
+ */
+static bool loopOnce()
+{
+  uint64_t sample = model.sampleTime;
+  Serial.clearOutput();
+  loop();
+  bool fresh = model.sampleTime != sample;
+  TEST_ASSERT_EQUAL(fresh ? 1 : 0, records());
+  return fresh;
+}
+
+// Every loop reads the ADC and logs the reading.
+void test_record_per_reading()
+{
+  for (uint16_t i = 0; i < LOOPS; i++)
+    TEST_ASSERT_TRUE(loopOnce());
+}
+
+// A reading lost to a bus timeout logs nothing, then logging resumes.
+void test_no_record_without_reading()
+{
+  uint16_t fresh = 0;
+  for (uint16_t i = 0; i < LOOPS; i++)
+  {
+    if (i % 5 == 0)
+      Wire.stalls = 1;
+    if (loopOnce())
+      fresh++;
+  }
+  TEST_ASSERT_LESS_THAN(LOOPS, fresh);
+  TEST_ASSERT_GREATER_THAN(0, fresh);
+
+  Wire.stalls = 0;
+  loops(10);
+  test_record_per_reading();
+}
+
+int main()
+{
+  setup();
+
+  // Carrier at 1 Mbaud with a record of every reading
+  simAnalog[A0] = 100;
+  FreqCount.count = FREQ_KHZ * 5L;
+  ltc230x::LTC230x::codes[0] = FWD_CODE;
+  ltc230x::LTC230x::codes[1] = REF_CODE;
+  command("U1000000\n");
+  command("K\n");
+  command("L1\n");
+  command("D1\n");
+  loops(50);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_record_per_reading);
+  RUN_TEST(test_no_record_without_reading);
+  return UNITY_END();
+}
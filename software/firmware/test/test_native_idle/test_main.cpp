@@ -0,0 +1,160 @@
+// Wake-up from the idle mode.
+//
+// With the meter idle a carrier is keyed at a series of times spread over
+// the RSSI poll interval. The first reading must be stamped, and a carrier
+// into a bad load must trip the protection, within WAKE_MAX_US of the key
+// time. The wake latency reported as wl, which runs to the end of the first
+// reading's calculation, must not exceed it either.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include "model.h"
+#include "calc.h"
+#include "idle.h"
+#include "protect.h"
+
+#define FREQ_KHZ 14200
+#define FWD_CODE 2000         // Forward detector code of the carrier
+#define GOOD_RL 25.0          // Return loss of the good load in dB
+#define BAD_RL 2.0            // Return loss of the bad load in dB, SWR 8.7
+#define KEYS 20               // Key times per test, spread over a poll interval
+#define KEY_STEP_US (IDLE_POLL_MS * 1000 / KEYS + 7)
+#define WAKE_MAX_US 10000UL   // A sleep tick, the RSSI read and the first reading
+#define FWD_CHANNEL 0
+#define REF_CHANNEL 1
+
+extern Model model;
+extern Calc calc;
+void setup();
+void loop();
+
+static uint16_t goodRef;  // Reflected code of the good load
+static uint16_t badRef;   // Reflected code of the bad load
+static uint16_t keyRef;   // Reflected code of the load keyed into
+static uint64_t keyedNs;  // Time the carrier was keyed
+
+void setUp() {}
+void tearDown() {}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends a command line and runs the loop until it is taken.
+static void command(const char *line)
+{
+  Serial.inject(line);
+  loops(3);
+}
+
+static void key()
+{
+  simAnalog[A0] = 100;
+  ltc230x::LTC230x::codes[REF_CHANNEL] = keyRef;
+  keyedNs = simNs;
+}
+
+// Unkeys and runs the loop until the meter has gone idle.
+static void goIdle()
+{
+  simAnalog[A0] = 0;
+  ltc230x::LTC230x::codes[REF_CHANNEL] = goodRef;
+  unsigned long start = millis();
+  while (!model.idle && millis() - start < 2 * IDLE_TIMEOUT_MS)
+    loop();
+  TEST_ASSERT_TRUE(model.idle);
+  loops(3);
+}
+
+/**
+ * Keys a carrier offsetUs into the idle wait and returns the time until the
+ * first reading, as stamped with the middle of its averaging window.
+ */
+static uint32_t readingLatency(uint32_t offsetUs)
+{
+  goIdle();
+  uint64_t sample = model.sampleTime;
+  simAt(simMicros() + offsetUs, key);
+  for (uint16_t i = 0; i < 100 && model.sampleTime == sample; i++)
+    loop();
+  TEST_ASSERT_FALSE(model.idle);
+  TEST_ASSERT_NOT_EQUAL(sample, model.sampleTime);
+  TEST_ASSERT_LESS_OR_EQUAL(WAKE_MAX_US, model.wakeLatency);
+  return model.sampleTime - keyedNs / 1000;
+}
+
+/**
+ * Keys a carrier into the bad load offsetUs into the idle wait and returns
+ * the time until the trip output went high, then resets the trip.
+ */
+static uint32_t tripLatency(uint32_t offsetUs)
+{
+  goIdle();
+  uint16_t trips = simDrivenHigh[PROTECT_TRIP_PIN];
+  simAt(simMicros() + offsetUs, key);
+  for (uint16_t i = 0; i < 100 && simDrivenHigh[PROTECT_TRIP_PIN] == trips; i++)
+    loop();
+  TEST_ASSERT_EQUAL(trips + 1, simDrivenHigh[PROTECT_TRIP_PIN]);
+  uint32_t us = (simHighNs[PROTECT_TRIP_PIN] - keyedNs) / 1000;
+
+  ltc230x::LTC230x::codes[REF_CHANNEL] = goodRef;
+  command("R\n");
+  TEST_ASSERT_FALSE(model.tripped);
+  return us;
+}
+
+// Returns the worst of a latency over key times spread over the poll interval.
+static uint32_t worst(uint32_t (*latency)(uint32_t), const char *what)
+{
+  uint32_t worst = 0;
+  for (uint16_t i = 0; i < KEYS; i++)
+  {
+    uint32_t us = latency(i * KEY_STEP_US);
+    if (us > worst)
+      worst = us;
+  }
+
+  char message[48];
+  snprintf(message, sizeof(message), "worst %s latency %lu us", what, static_cast<unsigned long>(worst));
+  TEST_MESSAGE(message);
+  return worst;
+}
+
+// The first reading after keying is done within the bound.
+void test_wake_latency()
+{
+  keyRef = goodRef;
+  TEST_ASSERT_LESS_OR_EQUAL(WAKE_MAX_US, worst(readingLatency, "reading"));
+}
+
+// A carrier keyed into a bad load trips the protection within the bound.
+void test_wake_trip_latency()
+{
+  keyRef = badRef;
+  TEST_ASSERT_LESS_OR_EQUAL(WAKE_MAX_US, worst(tripLatency, "trip"));
+}
+
+int main()
+{
+  setup();
+
+  // Logging at 1 Mbaud, the load good until a test keys into the bad one
+  FreqCount.count = FREQ_KHZ * 5L;
+  command("U1000000\n");
+  command("K\n");
+  goodRef = static_cast<uint16_t>(calc.refVoltage(calc.fwdPower(FWD_CODE) - GOOD_RL));
+  badRef = static_cast<uint16_t>(calc.refVoltage(calc.fwdPower(FWD_CODE) - BAD_RL));
+  ltc230x::LTC230x::codes[FWD_CHANNEL] = FWD_CODE;
+  ltc230x::LTC230x::codes[REF_CHANNEL] = goodRef;
+  simAnalog[A0] = 100;
+  loops(50);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_wake_latency);
+  RUN_TEST(test_wake_trip_latency);
+  return UNITY_END();
+}
@@ -0,0 +1,250 @@
+// Multi-port acquisition, built with PORT_COUNT > 1 by the native_ports env.
+//
+// The enabled ports must be read round-robin at the rates set by their
+// dividers, with the trims set at run time, and a fault on any port must
+// trip the protection within LATENCY_MAX_US, also with the longest
+// averaging window. The aggregate reading rate for one to PORT_COUNT ports
+// is reported and must not fall below MIN_RATE_SHARE of the one port rate.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include <stdlib.h>
+#include <string.h>
+#include "model.h"
+#include "calc.h"
+#include "protect.h"
+
+#if PORT_COUNT < 2
+#error "test_native_ports needs PORT_COUNT > 1, run it with the native_ports env"
+#endif
+
+#define FREQ_KHZ 14200
+#define FWD_CODE 2000          // Forward detector code of the carrier on every port
+#define GOOD_RL 25.0           // Return loss of the good load in dB
+#define BAD_RL 2.0             // Return loss of the bad load in dB, SWR 8.7
+#define INJECTIONS 40          // Load faults per port, spread over the loop
+#define INJECTION_STEP_US 509  // Spacing of the fault times within the loop
+#define LATENCY_MAX_US 5000UL  // Bound on the detection latency, as for one port
+#define PASSES 200             // Loop passes counted for the read rates
+#define ALL_PORTS ((1 << PORT_COUNT) - 1)
+#define TRIM_PORT (PORT_COUNT - 1) // Port the trims are set on
+#define MIN_RATE_SHARE 70      // Lowest aggregate rate of all ports, percent of one port's
+
+extern Model model;
+extern Calc calc;
+void setup();
+void loop();
+
+static uint16_t goodRef;   // Reflected code of the good load
+static uint16_t badRef;    // Reflected code of the bad load
+static uint8_t faultPort;  // Port whose load turns bad
+static uint64_t injectedNs; // Time the load turned bad
+
+void setUp() {}
+void tearDown() {}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends a command line and runs the loop until it is taken.
+static void command(const char *line)
+{
+  Serial.inject(line);
+  loops(3);
+}
+
+// Sends a command line and checks that it is answered with the given line,
+// among the records.
+static void assertAnswer(const char *line, const char *answer)
+{
+  Serial.clearOutput();
+  command(line);
+  TEST_ASSERT_NOT_NULL_MESSAGE(strstr(Serial.output(), answer), line);
+}
+
+// Counts the readings of each port over PASSES loop passes.
+static void countReadings(uint16_t counts[PORT_COUNT])
+{
+  memset(counts, 0, PORT_COUNT * sizeof(counts[0]));
+  for (uint16_t i = 0; i < PASSES; i++)
+  {
+    uint64_t sample = model.sampleTime;
+    loop();
+    if (model.sampleTime != sample)
+      counts[model.port]++;
+  }
+}
+
+// Every enabled port is read in turn, the others not at all.
+void test_round_robin()
+{
+  uint16_t counts[PORT_COUNT];
+  countReadings(counts);
+  for (uint8_t p = 1; p < PORT_COUNT; p++)
+    TEST_ASSERT_INT_WITHIN(1, counts[0], counts[p]);
+
+  char line[8];
+  snprintf(line, sizeof(line), "M%u\n", ALL_PORTS & ~2);
+  command(line);
+  countReadings(counts);
+  TEST_ASSERT_EQUAL(0, counts[1]);
+  TEST_ASSERT_GREATER_THAN(0, counts[0]);
+  for (uint8_t p = 2; p < PORT_COUNT; p++)
+    TEST_ASSERT_INT_WITHIN(1, counts[0], counts[p]);
+  snprintf(line, sizeof(line), "M%u\n", ALL_PORTS);
+  command(line);
+}
+
+// N sets the divider of the displayed port, which is then read less often.
+void test_divider()
+{
+  command("O1\n");
+  assertAnswer("N4\n", "{\"ok\":\"N\"}\r\n");
+  assertAnswer("N\n", "{\"port\":1,\"div\":4,\"ft\":0,\"rt\":0}\r\n");
+  assertAnswer("N0\n", "{\"err\":\"N\"}\r\n");
+  assertAnswer("N256\n", "{\"err\":\"N\"}\r\n");
+
+  uint16_t counts[PORT_COUNT];
+  countReadings(counts);
+  TEST_ASSERT_INT_WITHIN(4, counts[0], counts[1] * 4);
+
+  command("N1\n");
+  command("O0\n");
+}
+
+// I and J set the signed detector trims of the displayed port.
+void test_trims()
+{
+  char line[40];
+  snprintf(line, sizeof(line), "O%u\n", TRIM_PORT);
+  command(line);
+  assertAnswer("I-5\n", "{\"ok\":\"I\"}\r\n");
+  assertAnswer("J7\n", "{\"ok\":\"J\"}\r\n");
+  snprintf(line, sizeof(line), "{\"port\":%u,\"div\":1,\"ft\":-5,\"rt\":7}\r\n", TRIM_PORT);
+  assertAnswer("N\n", line);
+  assertAnswer("I1001\n", "{\"err\":\"I\"}\r\n");
+  assertAnswer("J-1001\n", "{\"err\":\"J\"}\r\n");
+  assertAnswer("J-\n", "{\"err\":\"J\"}\r\n");
+  assertAnswer("N-1\n", "{\"err\":\"N\"}\r\n");
+
+  loops(2 * PORT_COUNT);
+  TEST_ASSERT_EQUAL(model.ports[0].fwdRaw - 5 * ADC_SCALE, model.ports[TRIM_PORT].fwdRaw);
+  TEST_ASSERT_EQUAL(model.ports[0].refRaw + 7 * ADC_SCALE, model.ports[TRIM_PORT].refRaw);
+
+  command("I0\n");
+  command("J0\n");
+  command("O0\n");
+}
+
+static void injectFault()
+{
+  ltc230x::LTC230x::codes[2 * faultPort + 1] = badRef;
+  injectedNs = simNs;
+}
+
+/**
+ * Turns the load of the port bad at a series of times spread over the loop
+ * and returns the worst time until the trip output went high.
+ */
+static uint32_t worstLatency(uint8_t port)
+{
+  faultPort = port;
+  uint32_t worst = 0;
+  for (uint16_t i = 0; i < INJECTIONS; i++)
+  {
+    uint16_t trips = simDrivenHigh[PROTECT_TRIP_PIN];
+    simAt(simMicros() + i * INJECTION_STEP_US, injectFault);
+    for (uint16_t n = 0; n < 100 && simDrivenHigh[PROTECT_TRIP_PIN] == trips; n++)
+      loop();
+    TEST_ASSERT_EQUAL(trips + 1, simDrivenHigh[PROTECT_TRIP_PIN]);
+    uint32_t us = (simHighNs[PROTECT_TRIP_PIN] - injectedNs) / 1000;
+    if (us > worst)
+      worst = us;
+
+    ltc230x::LTC230x::codes[2 * port + 1] = goodRef;
+    command("R\n");
+    TEST_ASSERT_FALSE(model.tripped);
+  }
+
+  char message[64];
+  snprintf(message, sizeof(message), "port %u, window %u: worst latency %lu us",
+           port, model.avgWindow, static_cast<unsigned long>(worst));
+  TEST_MESSAGE(message);
+  return worst;
+}
+
+// A fault on any port trips within the bound of a single port.
+void test_latency_every_port()
+{
+  for (uint8_t p = 0; p < PORT_COUNT; p++)
+    TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(p));
+}
+
+// Also while another port is read with the longest averaging window.
+void test_latency_long_window()
+{
+  command("A256\n");
+  TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(PORT_COUNT - 1));
+  command("A16\n");
+}
+
+// Returns the aggregate reading rate with the ports of the mask enabled.
+static uint16_t readingRate(uint8_t mask)
+{
+  char line[8];
+  snprintf(line, sizeof(line), "M%u\n", mask);
+  command(line);
+  unsigned long start = millis();
+  while (millis() - start < 2500)
+    loop();
+  return model.readingRate;
+}
+
+// The aggregate rate stays close to the one port rate as ports are added.
+void test_throughput()
+{
+  uint16_t one = readingRate(1);
+  uint16_t all = one;
+  char message[64];
+  for (uint8_t n = 2; n <= PORT_COUNT; n++)
+  {
+    all = readingRate((1 << n) - 1);
+    snprintf(message, sizeof(message), "%u ports: %u readings/s, 1 port: %u", n, all, one);
+    TEST_MESSAGE(message);
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(one * MIN_RATE_SHARE / 100, all);
+}
+
+int main()
+{
+  setup();
+
+  // Carrier into good loads on every port, at 1 Mbaud with every reading logged
+  simAnalog[A0] = 100;
+  FreqCount.count = FREQ_KHZ * 5L;
+  command("U1000000\n");
+  command("K\n");
+  loops(50);
+  goodRef = static_cast<uint16_t>(calc.refVoltage(calc.fwdPower(FWD_CODE) - GOOD_RL));
+  badRef = static_cast<uint16_t>(calc.refVoltage(calc.fwdPower(FWD_CODE) - BAD_RL));
+  for (uint8_t p = 0; p < PORT_COUNT; p++)
+  {
+    ltc230x::LTC230x::codes[2 * p] = FWD_CODE;
+    ltc230x::LTC230x::codes[2 * p + 1] = goodRef;
+  }
+  loops(50);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_round_robin);
+  RUN_TEST(test_divider);
+  RUN_TEST(test_trims);
+  RUN_TEST(test_latency_every_port);
+  RUN_TEST(test_latency_long_window);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,231 @@
+// Worst-case SWR protection latency through the whole firmware loop.
+//
+// The firmware runs on the simulated clock of test/stub/native. A carrier
+// into a good load is applied, then at a series of times spread over the
+// loop the load turns bad, and the time until the trip output goes high is
+// measured, also at 57600 baud with a status report or band scan dump being
+// printed, and when the carrier is keyed into the bad load while the meter
+// is idle. Bus and serial times are simulated, text rendering is charged
+// GFX_CHAR_US per character; the rest of the CPU time is not simulated, see
+// test/test_bench for it.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include "model.h"
+#include "calc.h"
+#include "protect.h"
+#include "idle.h"
+
+#define FREQ_KHZ 14200
+#define FWD_CODE 2000               // Forward detector code of the carrier, about 35 dBm
+#define GOOD_RL 25.0                // Return loss of the good load in dB
+#define BAD_RL 2.0                  // Return loss of the bad load in dB, SWR 8.7
+#define INJECTIONS 40               // Load faults per screen, over a loop at 1 Mbaud
+#define SLOW_INJECTIONS 80          // Load faults over a loop at 57600 baud
+#define INJECTION_STEP_US 509       // Spacing of the fault times within the loop
+#define LATENCY_MAX_US 5000UL       // Bound on the detection latency
+#define WAKES 20                    // Key times from idle, spread over the RSSI poll interval
+#define WAKE_STEP_US (IDLE_POLL_MS * 1000 / WAKES + 7)
+#define FWD_CHANNEL 0               // Detector channels of port 0
+#define REF_CHANNEL 1
+
+extern Model model;
+extern Calc calc;
+void setup();
+void loop();
+
+static uint16_t goodRef;    // Reflected code of the good load
+static uint16_t badRef;     // Reflected code of the bad load
+static uint64_t injectedNs; // Time the load turned bad
+static const char *pending; // Command sent with each fault
+
+void setUp() {}
+void tearDown() {}
+
+static void injectFault()
+{
+  ltc230x::LTC230x::codes[REF_CHANNEL] = badRef;
+  injectedNs = simNs;
+}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends a command line and runs the loop until it is taken.
+static void command(const char *line)
+{
+  Serial.inject(line);
+  loops(3);
+}
+
+/**
+ * Sends the pending command, if any, turns the load bad offsetUs from now
+ * and returns the time until the trip output went high, then restores the
+ * load and resets the trip.
+ */
+static uint32_t latency(uint32_t offsetUs)
+{
+  uint16_t trips = simDrivenHigh[PROTECT_TRIP_PIN];
+  if (pending)
+    Serial.inject(pending);
+  simAt(simMicros() + offsetUs, injectFault);
+  for (uint16_t i = 0; i < 100 && simDrivenHigh[PROTECT_TRIP_PIN] == trips; i++)
+    loop();
+  TEST_ASSERT_EQUAL(trips + 1, simDrivenHigh[PROTECT_TRIP_PIN]);
+  TEST_ASSERT_TRUE(model.tripped);
+  uint32_t us = (simHighNs[PROTECT_TRIP_PIN] - injectedNs) / 1000;
+
+  ltc230x::LTC230x::codes[REF_CHANNEL] = goodRef;
+  command("R\n");
+  TEST_ASSERT_FALSE(model.tripped);
+  TEST_ASSERT_EQUAL(LOW, digitalRead(PROTECT_TRIP_PIN));
+  return us;
+}
+
+// Returns the worst latency of faults spread over the loop on a screen.
+static uint32_t worstLatency(Screen scr, uint16_t injections = INJECTIONS)
+{
+  char line[8];
+  snprintf(line, sizeof(line), "S%d\n", static_cast<int>(scr));
+  command(line);
+  TEST_ASSERT_EQUAL(scr, model.scr);
+
+  uint32_t worst = 0;
+  for (uint16_t i = 0; i < injections; i++)
+  {
+    uint32_t us = latency(i * INJECTION_STEP_US);
+    if (us > worst)
+      worst = us;
+  }
+
+  char message[48];
+  snprintf(message, sizeof(message), "screen %d: worst latency %lu us", static_cast<int>(scr), static_cast<unsigned long>(worst));
+  TEST_MESSAGE(message);
+  return worst;
+}
+
+void test_latency_main() { TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(MAIN)); }
+void test_latency_info() { TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(INFO)); }
+void test_latency_dbm() { TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(DBM)); }
+void test_latency_raw() { TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(RAW)); }
+void test_latency_trend() { TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(TREND)); }
+void test_latency_scan() { TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(SCAN)); }
+
+// At 57600 baud the output waits for room in the transmit buffer, polling
+// the protection meanwhile.
+void test_latency_slow_link()
+{
+  command("U57600\n");
+  command("K\n");
+  TEST_ASSERT_EQUAL(57600, Serial.baud);
+  TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(MAIN, SLOW_INJECTIONS));
+}
+
+// So do the answers to queries, here sent together so they fill the buffer.
+void test_latency_status_pending()
+{
+  pending = "Z\n?\nF\n";
+  TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worstLatency(MAIN, SLOW_INJECTIONS));
+  pending = nullptr;
+}
+
+static void keyBad()
+{
+  simAnalog[A0] = 100;
+  injectFault();
+}
+
+// A carrier keyed into the bad load while idle trips within the bound too.
+void test_latency_wake()
+{
+  uint32_t worst = 0;
+  for (uint16_t i = 0; i < WAKES; i++)
+  {
+    simAnalog[A0] = 0;
+    unsigned long start = millis();
+    while (!model.idle && millis() - start < 2 * IDLE_TIMEOUT_MS)
+      loop();
+    TEST_ASSERT_TRUE(model.idle);
+    loops(3);
+
+    uint16_t trips = simDrivenHigh[PROTECT_TRIP_PIN];
+    simAt(simMicros() + i * WAKE_STEP_US, keyBad);
+    for (uint16_t n = 0; n < 100 && simDrivenHigh[PROTECT_TRIP_PIN] == trips; n++)
+      loop();
+    TEST_ASSERT_EQUAL(trips + 1, simDrivenHigh[PROTECT_TRIP_PIN]);
+    uint32_t us = (simHighNs[PROTECT_TRIP_PIN] - injectedNs) / 1000;
+    if (us > worst)
+      worst = us;
+
+    ltc230x::LTC230x::codes[REF_CHANNEL] = goodRef;
+    command("R\n");
+    TEST_ASSERT_FALSE(model.tripped);
+  }
+
+  char message[48];
+  snprintf(message, sizeof(message), "wake: worst latency %lu us", static_cast<unsigned long>(worst));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_OR_EQUAL(LATENCY_MAX_US, worst);
+}
+
+static uint32_t tripWrites; // Level changes of the trip output
+
+static void countTripWrites(uint8_t pin)
+{
+  if (pin == PROTECT_TRIP_PIN)
+    tripWrites++;
+}
+
+// A latched trip drives the output once, not on every sample.
+void test_trip_written_once()
+{
+  ltc230x::LTC230x::codes[REF_CHANNEL] = badRef;
+  loop();
+  TEST_ASSERT_TRUE(model.tripped);
+
+  tripWrites = 0;
+  simPinChange = countTripWrites;
+  loops(20);
+  simPinChange = nullptr;
+  TEST_ASSERT_TRUE(model.tripped);
+  TEST_ASSERT_EQUAL(0, tripWrites);
+
+  ltc230x::LTC230x::codes[REF_CHANNEL] = goodRef;
+  command("R\n");
+  TEST_ASSERT_FALSE(model.tripped);
+}
+
+int main()
+{
+  setup();
+
+  // Carrier into the good load, at 1 Mbaud with a record of every reading
+  simAnalog[A0] = 100;
+  FreqCount.count = FREQ_KHZ * 5L;
+  command("U1000000\n");
+  command("K\n");
+  loops(50);
+  goodRef = static_cast<uint16_t>(calc.refVoltage(calc.fwdPower(FWD_CODE) - GOOD_RL));
+  badRef = static_cast<uint16_t>(calc.refVoltage(calc.fwdPower(FWD_CODE) - BAD_RL));
+  ltc230x::LTC230x::codes[FWD_CHANNEL] = FWD_CODE;
+  ltc230x::LTC230x::codes[REF_CHANNEL] = goodRef;
+  loops(50);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_trip_written_once);
+  RUN_TEST(test_latency_main);
+  RUN_TEST(test_latency_info);
+  RUN_TEST(test_latency_dbm);
+  RUN_TEST(test_latency_raw);
+  RUN_TEST(test_latency_trend);
+  RUN_TEST(test_latency_scan);
+  RUN_TEST(test_latency_slow_link);
+  RUN_TEST(test_latency_status_pending);
+  RUN_TEST(test_latency_wake);
+  return UNITY_END();
+}
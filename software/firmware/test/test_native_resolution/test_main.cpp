@@ -0,0 +1,122 @@
+// Resolution gained by averaging the ADC samples.
+//
+// The LTC2309 stand-in adds a fixed pseudo-random sequence of triangular
+// noise to a detector voltage that lies between two codes. For each
+// averaging window the readings kept in 1/16 mV by Adc::average() must
+// scatter less, by about the square root of the window, down to the
+// ADC_FRAC_BITS step, and their mean must find the voltage between the codes.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include <math.h>
+#include "model.h"
+
+#define FREQ_KHZ 14200
+#define FWD_CODE 1500        // Forward detector code of the carrier
+#define FWD_FRACTION 5       // Sixteenths of a code above it
+#define REF_CODE 900         // Reflected detector code of the carrier
+#define NOISE_CODES 2        // Peak noise of each sample, a sigma of 0.8 codes
+#define READINGS 200         // Readings per window
+#define SIGMA_MARGIN 1.25    // Allowance over sigma(1) / sqrt(n) for the estimate
+#define FWD_CHANNEL 0
+#define REF_CHANNEL 1
+
+extern Model model;
+void setup();
+void loop();
+
+static double sigmaOne; // Scatter of single samples in 1/16 mV
+
+void setUp() {}
+void tearDown() {}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends a command line and runs the loop until it is taken.
+static void command(const char *line)
+{
+  Serial.inject(line);
+  loops(3);
+}
+
+/**
+ * Reads READINGS forward voltages with the window and returns their standard
+ * deviation in 1/16 mV, checking their mean against the true voltage.
+ */
+static double sigma(uint16_t window)
+{
+  char line[8];
+  snprintf(line, sizeof(line), "A%u\n", window);
+  command(line);
+  TEST_ASSERT_EQUAL(window, model.avgWindow);
+
+  // Welford's running variance, like pmrecv --enob
+  double mean = 0, m2 = 0;
+  for (uint16_t n = 1; n <= READINGS; n++)
+  {
+    uint64_t sample = model.sampleTime;
+    while (model.sampleTime == sample)
+      loop();
+    double delta = model.ports[0].fwdRaw - mean;
+    mean += delta / n;
+    m2 += delta * (model.ports[0].fwdRaw - mean);
+  }
+  double s = sqrt(m2 / (READINGS - 1));
+
+  double truth = FWD_CODE * ADC_SCALE + FWD_FRACTION * ADC_SCALE / 16.0;
+  char message[80];
+  snprintf(message, sizeof(message), "window %3u: sigma %.2f/16 mV, mean %+.2f/16 mV off, %.2f bits gained",
+           window, s, mean - truth, window == 1 ? 0.0 : log2(sigmaOne / s));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_DOUBLE_WITHIN(3 * s / sqrt(READINGS) + 0.5, truth, mean);
+  return s;
+}
+
+// Single samples scatter by the noise, each code a 1/16 mV step of 16.
+void test_single_samples()
+{
+  sigmaOne = sigma(1);
+  TEST_ASSERT_DOUBLE_WITHIN(0.2 * ADC_SCALE, NOISE_CODES / sqrt(6.0) * ADC_SCALE, sigmaOne);
+}
+
+// Each fourfold window halves the scatter, a bit gained per two octaves,
+// until the 1/16 mV step of the fraction bits is reached.
+void test_resolution_improves_with_window()
+{
+  double last = sigmaOne;
+  for (uint16_t window = 4; window <= 256; window *= 4)
+  {
+    double s = sigma(window);
+    double expected = sigmaOne / sqrt(static_cast<double>(window));
+    double step = 1 / sqrt(12.0); // Rounding to the 1/16 mV step
+    TEST_ASSERT_LESS_THAN(last, s);
+    TEST_ASSERT_LESS_OR_EQUAL(SIGMA_MARGIN * sqrt(expected * expected + step * step), s);
+    last = s;
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(ADC_FRAC_BITS - 0.5, log2(sigmaOne / last));
+}
+
+int main()
+{
+  setup();
+
+  // Steady carrier between two forward codes, read with the noise
+  simAnalog[A0] = 100;
+  FreqCount.count = FREQ_KHZ * 5L;
+  ltc230x::LTC230x::codes[FWD_CHANNEL] = FWD_CODE;
+  ltc230x::LTC230x::fraction[FWD_CHANNEL] = FWD_FRACTION;
+  ltc230x::LTC230x::codes[REF_CHANNEL] = REF_CODE;
+  ltc230x::LTC230x::noise = NOISE_CODES;
+  loops(50);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_single_samples);
+  RUN_TEST(test_resolution_improves_with_window);
+  return UNITY_END();
+}
@@ -0,0 +1,122 @@
+// Band scan means and bin keys.
+//
+// The mean SWR of a bin must follow a change smaller than the mean window
+// in SWR steps, which integer division of the difference would lose, and
+// frequencies whose bin number would reach SCAN_EMPTY must be dropped.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include "model.h"
+#include "calc.h"
+
+#define FREQ_KHZ 14200
+#define FWD_CODE 2000 // Forward detector code of the carrier
+#define FIRST_RL 20.0 // Return loss of the first load in dB, SWR 1.22
+#define SECOND_RL 18.0 // Return loss of the second load in dB, SWR 1.29
+#define FWD_CHANNEL 0
+#define REF_CHANNEL 1
+
+extern Model model;
+extern Calc calc;
+void setup();
+void loop();
+
+void setUp() {}
+void tearDown() {}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends a command line and runs the loop until it is taken.
+static void command(const char *line)
+{
+  Serial.inject(line);
+  loops(3);
+}
+
+// Applies a load of the given return loss and returns its SWR times 100.
+static uint16_t load(double rl)
+{
+  ltc230x::LTC230x::codes[REF_CHANNEL] = static_cast<uint16_t>(calc.refVoltage(calc.fwdPower(FWD_CODE) - rl));
+  loops(2);
+  return static_cast<uint16_t>(model.swr() * 100.0);
+}
+
+// Returns the bin of a frequency, nullptr if there is none.
+static const ScanBin *bin(uint32_t khz)
+{
+  for (uint8_t i = 0; i < SCAN_BINS; i++)
+  {
+    if (model.scan[i].key != SCAN_EMPTY && model.scan[i].key == khz / model.scanBinKhz)
+      return &model.scan[i];
+  }
+  return nullptr;
+}
+
+// The mean follows a step of a few SWR hundredths once the window is full.
+void test_mean_follows_small_step()
+{
+  uint16_t first = load(FIRST_RL);
+  command("X\n");
+  loops(2 * SCAN_MEAN_WINDOW);
+  const ScanBin *b = bin(FREQ_KHZ);
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_UINT16_WITHIN(1, first, b->meanSwr());
+
+  uint16_t second = load(SECOND_RL);
+  TEST_ASSERT_GREATER_THAN(first, second);
+  TEST_ASSERT_LESS_THAN(first + SCAN_MEAN_WINDOW, second);
+  loops(10 * SCAN_MEAN_WINDOW);
+  TEST_ASSERT_UINT16_WITHIN(1, second, b->meanSwr());
+  TEST_ASSERT_UINT16_WITHIN(1, first, b->minSwr);
+}
+
+// The mean power is rounded, not truncated towards zero.
+void test_mean_power_rounded()
+{
+  command("X\n");
+  loops(2 * SCAN_MEAN_WINDOW);
+  const ScanBin *b = bin(FREQ_KHZ);
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_INT16_WITHIN(1, static_cast<int16_t>(lround(model.fwdp * 10.0)), b->meanFwd());
+}
+
+// A bin number at or above SCAN_EMPTY is dropped, not stored.
+void test_key_out_of_range_dropped()
+{
+  FreqCount.count = 70000 * 5L;
+  loops(10);
+  TEST_ASSERT_EQUAL(70000, model.freq);
+  command("X1\n");
+  loops(10);
+  TEST_ASSERT_EQUAL(0, model.scanUsed);
+  TEST_ASSERT_GREATER_THAN(0, model.scanDropped);
+  for (uint8_t i = 0; i < SCAN_BINS; i++)
+    TEST_ASSERT_EQUAL_HEX16(SCAN_EMPTY, model.scan[i].key);
+
+  FreqCount.count = FREQ_KHZ * 5L;
+  loops(10);
+  command("X10\n");
+}
+
+int main()
+{
+  setup();
+
+  // Carrier into the first load
+  simAnalog[A0] = 100;
+  FreqCount.count = FREQ_KHZ * 5L;
+  ltc230x::LTC230x::codes[FWD_CHANNEL] = FWD_CODE;
+  loops(50);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_mean_follows_small_step);
+  RUN_TEST(test_mean_power_rounded);
+  RUN_TEST(test_key_out_of_range_dropped);
+  return UNITY_END();
+}
@@ -0,0 +1,137 @@
+// Transmission summaries count every reading of the transmission.
+//
+// With every measurement logged, the readings counted in a transmission's
+// summary must equal the records of the displayed port logged while it
+// lasted, the reading taken at key-down included, and not the powers left
+// in the model by a pass that read nothing.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include <stdlib.h>
+#include <string.h>
+#include <Wire.h>
+#include "model.h"
+#include "segment.h"
+#include "enc.h"
+
+#define FREQ_KHZ 14200
+#define FWD_CODE 2000 // Forward detector code of the carrier
+#define REF_CODE 1400 // Reflected detector code of the carrier
+#define KEYED_LOOPS 20
+
+extern Model model;
+void setup();
+void loop();
+
+void setUp() {}
+void tearDown() {}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends a command line and runs the loop until it is taken.
+static void command(const char *line)
+{
+  Serial.inject(line);
+  loops(3);
+}
+
+// Returns the number of measurement records of the displayed port in the serial output.
+static uint16_t records()
+{
+  uint16_t n = 0;
+  for (const char *s = Serial.output(); (s = strstr(s, "{\"t\":")) != nullptr; s++)
+  {
+#if PORT_COUNT > 1
+    const char *port = strstr(s, "\"p\":");
+    if (port == nullptr || strtol(port + 4, nullptr, 10) != model.selPort)
+      continue;
+#endif
+    n++;
+  }
+  return n;
+}
+
+// Keys a carrier for KEYED_LOOPS loops and returns the summary's reading count.
+static long transmission()
+{
+  Serial.clearOutput();
+  simAnalog[A0] = 100;
+  loops(KEYED_LOOPS);
+  simAnalog[A0] = 0;
+  uint16_t logged = records();
+  TEST_ASSERT_TRUE(model.keyed);
+  TEST_ASSERT_GREATER_THAN(0, logged);
+
+  Serial.clearOutput();
+  unsigned long start = millis();
+  while (model.keyed && millis() - start < 2 * SEGMENT_HANG_MS)
+    loop();
+  TEST_ASSERT_FALSE(model.keyed);
+
+  const char *summary = strstr(Serial.output(), "{\"tx\":");
+  TEST_ASSERT_NOT_NULL(summary);
+  const char *n = strstr(summary, "\"n\":");
+  TEST_ASSERT_NOT_NULL(n);
+  TEST_ASSERT_EQUAL(logged, strtol(n + 4, nullptr, 10));
+  const char *swr = strstr(summary, "\"s\":");
+  TEST_ASSERT_NOT_NULL(swr);
+  TEST_ASSERT_LESS_THAN(SEGMENT_MAX_SWR, strtod(swr + 4, nullptr));
+  return logged;
+}
+
+// The first transmission after boot counts its key-down reading.
+void test_first_reading_counted()
+{
+  transmission();
+}
+
+// So does a later one, after the meter has been waiting without a carrier.
+void test_later_transmission_counted()
+{
+  loops(20);
+  transmission();
+}
+
+// A transmission keyed on a pass whose ADC read timed out counts neither
+// that pass nor the readings cleared by a button press before it.
+void test_stale_reading_not_counted()
+{
+  loops(20);
+  simPulledLow[ENC_BUTTON] = 1;
+  loops(2);
+  simPulledLow[ENC_BUTTON] = 0;
+  loops(2);
+  TEST_ASSERT_EQUAL(0, model.fwdp);
+
+  Wire.stalls = 1;
+  transmission();
+  TEST_ASSERT_EQUAL(0, Wire.stalls);
+}
+
+int main()
+{
+  setup();
+
+  // Every reading and the summaries logged, at 1 Mbaud
+  FreqCount.count = FREQ_KHZ * 5L;
+  ltc230x::LTC230x::codes[0] = FWD_CODE;
+  ltc230x::LTC230x::codes[1] = REF_CODE;
+  command("U1000000\n");
+  command("K\n");
+  command("L1\n");
+  command("D1\n");
+  command("E2\n");
+  loops(20);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_first_reading_counted);
+  RUN_TEST(test_later_transmission_counted);
+  RUN_TEST(test_stale_reading_not_counted);
+  return UNITY_END();
+}
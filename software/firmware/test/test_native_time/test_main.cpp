@@ -0,0 +1,92 @@
+// Clock sync error at the default link rate with every reading logged.
+//
+// The host clock of the test is the simulated clock, so after a T<us>
+// command the meter's clock offset is the error of the sync itself. The
+// command is sent at a series of times spread over the loop, while records
+// fill the serial transmit buffer at 57600 baud, and each sync must match
+// the host time to within SYNC_MAX_ERROR_US.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include <string.h>
+#include "model.h"
+
+#define FREQ_KHZ 14200
+#define FWD_CODE 2000             // Forward detector code of the carrier
+#define REF_CODE 1400             // Reflected detector code of the carrier
+#define SYNCS 40                  // Syncs sent, spread over the loop
+#define SYNC_STEP_US 1709         // Spacing of the send times within the loop
+#define SYNC_MAX_ERROR_US 5000L   // Bound on the sync error, the longest loop phase between stamps
+
+extern Model model;
+void setup();
+void loop();
+
+void setUp() {}
+void tearDown() {}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends T<us> with the current host time, as the host does.
+static void sendSync()
+{
+  char line[32];
+  snprintf(line, sizeof(line), "T%llu\n", static_cast<unsigned long long>(simMicros()));
+  Serial.inject(line);
+}
+
+/**
+ * Sends a sync offsetUs from now and returns the clock offset it left, the
+ * sync error, once it has been answered.
+ */
+static int32_t syncError(uint32_t offsetUs)
+{
+  Serial.clearOutput();
+  simAt(simMicros() + offsetUs, sendSync);
+  for (uint16_t i = 0; i < 100 && !strstr(Serial.output(), "{\"ok\":\"T\"}"); i++)
+    loop();
+  TEST_ASSERT_NOT_NULL(strstr(Serial.output(), "{\"ok\":\"T\"}"));
+  TEST_ASSERT_TRUE(model.clockSynced);
+  return static_cast<int32_t>(model.clockOffset);
+}
+
+// Every sync matches the host time, wherever in the loop it arrives.
+void test_sync_error()
+{
+  int32_t worst = 0;
+  for (uint16_t i = 0; i < SYNCS; i++)
+  {
+    int32_t error = syncError(i * SYNC_STEP_US);
+    if (abs(error) > abs(worst))
+      worst = error;
+  }
+
+  char message[48];
+  snprintf(message, sizeof(message), "worst sync error %ld us", static_cast<long>(worst));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_OR_EQUAL(SYNC_MAX_ERROR_US, abs(worst));
+}
+
+int main()
+{
+  setup();
+
+  // Carrier with every reading logged at the default rate
+  simAnalog[A0] = 100;
+  FreqCount.count = FREQ_KHZ * 5L;
+  ltc230x::LTC230x::codes[0] = FWD_CODE;
+  ltc230x::LTC230x::codes[1] = REF_CODE;
+  loops(50);
+  TEST_ASSERT_EQUAL(LINK_DEFAULT_BAUD, Serial.baud);
+  TEST_ASSERT_TRUE(model.logging);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_sync_error);
+  return UNITY_END();
+}
@@ -0,0 +1,184 @@
+// Auto-zero: off by default with the fixed clamp, the zero latched from the
+// first settled floor after power-up, and the drift measured from it.
+//
+// With no carrier the meter goes idle after IDLE_TIMEOUT_MS. The floors are
+// tracked in the quiet time after a carrier, and while idle from the floor
+// samples taken every IDLE_FLOOR_MS, with the ADC asleep in between.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <FreqCount.h>
+#include <LTC230x.hpp>
+#include "model.h"
+#include "zero.h"
+#include "idle.h"
+
+#define FREQ_KHZ 14200
+#define FWD_FLOOR 270  // Forward detector output with no signal in mV
+#define REF_FLOOR 260  // Reflected detector output with no signal in mV
+#define DRIFT 10       // Drift of the forward detector in mV
+#define IDLE_DRIFT 20  // Drift of the reflected detector while idle in mV
+#define IDLE_TRACK_MS 600000L // Idle time in which the floors must follow a drift
+#define FWD_CHANNEL 0
+#define REF_CHANNEL 1
+
+extern Model model;
+void setup();
+void loop();
+
+void setUp() {}
+void tearDown() {}
+
+static void loops(uint16_t n)
+{
+  while (n--)
+    loop();
+}
+
+// Sends a command line and runs the loop until it is taken.
+static void command(const char *line)
+{
+  Serial.inject(line);
+  loops(3);
+}
+
+// Runs the loop with no carrier for ms milliseconds.
+static void quiet(unsigned long ms)
+{
+  simAnalog[A0] = 0;
+  unsigned long start = millis();
+  while (millis() - start < ms)
+    loop();
+}
+
+// Keys a carrier briefly, so the meter is awake for the next IDLE_TIMEOUT_MS.
+static void wake()
+{
+  simAnalog[A0] = 100;
+  loops(3);
+  simAnalog[A0] = 0;
+}
+
+static void detectors(uint16_t fwd, uint16_t ref)
+{
+  ltc230x::LTC230x::codes[FWD_CHANNEL] = fwd;
+  ltc230x::LTC230x::codes[REF_CHANNEL] = ref;
+}
+
+// The floors of the first quiet period after power-up are latched as the zero.
+void test_zero_latched_after_power_up()
+{
+  TEST_ASSERT_FALSE(model.ports[0].zeroLatched);
+  quiet(IDLE_TIMEOUT_MS);
+  const PortReading &r = model.ports[0];
+  TEST_ASSERT_TRUE(r.zeroLatched);
+  TEST_ASSERT_INT_WITHIN(ADC_SCALE, FWD_FLOOR * ADC_SCALE, r.fwdZero);
+  TEST_ASSERT_INT_WITHIN(ADC_SCALE, REF_FLOOR * ADC_SCALE, r.refZero);
+  TEST_ASSERT_EQUAL(0, r.fwdDrift);
+}
+
+// With the auto-zero off, the default, readings below the fixed clamp are noise.
+void test_fixed_clamp_when_off()
+{
+  TEST_ASSERT_FALSE(model.zeroEnabled);
+  wake();
+  quiet(100);
+  TEST_ASSERT_EQUAL(0, model.ports[0].fwdV);
+
+  // Above the floor margin but below the fixed clamp
+  detectors(ZERO_FIXED_CLAMP - 10, REF_FLOOR);
+  loops(5);
+  TEST_ASSERT_EQUAL(0, model.ports[0].fwdV);
+  detectors(ZERO_FIXED_CLAMP + 10, REF_FLOOR);
+  loops(5);
+  TEST_ASSERT_EQUAL((ZERO_FIXED_CLAMP + 10) * ADC_SCALE, model.ports[0].fwdV);
+  detectors(FWD_FLOOR, REF_FLOOR);
+}
+
+// With the auto-zero on, a reading past the floor margin is signal and the
+// drift is taken from the latched zero, not the nominal floor.
+void test_drift_from_latched_zero()
+{
+  command("Z1\n");
+  TEST_ASSERT_TRUE(model.zeroEnabled);
+  wake();
+  quiet(IDLE_TIMEOUT_MS);
+  const PortReading &r = model.ports[0];
+  TEST_ASSERT_INT_WITHIN(ADC_SCALE, 0, r.fwdDrift);
+
+  wake();
+  detectors(FWD_FLOOR + ZERO_MARGIN + 10, REF_FLOOR);
+  loops(5);
+  TEST_ASSERT_NOT_EQUAL(0, r.fwdV);
+
+  detectors(FWD_FLOOR + DRIFT, REF_FLOOR);
+  for (uint8_t i = 0; i < 10; i++)
+  {
+    wake();
+    quiet(IDLE_TIMEOUT_MS);
+  }
+  TEST_ASSERT_INT_WITHIN(ADC_SCALE, DRIFT * ADC_SCALE, r.fwdDrift);
+  TEST_ASSERT_INT_WITHIN(ADC_SCALE, 0, r.refDrift);
+
+  command("Z0\n");
+  TEST_ASSERT_EQUAL(0, r.fwdDrift);
+}
+
+static uint32_t adcReads; // ADC reads while idle
+
+// Counts the ADC reads of the loop pass that just ran.
+static void idleLoop()
+{
+  uint32_t reads = ltc230x::LTC230x::reads;
+  loop();
+  TEST_ASSERT_TRUE(model.idle);
+  adcReads += ltc230x::LTC230x::reads - reads;
+}
+
+// While idle the ADC is woken for floor samples, so a drift between
+// transmissions is followed with the ADC asleep most of the time.
+void test_floor_tracked_while_idle()
+{
+  command("Z1\n");
+  wake();
+  quiet(IDLE_TIMEOUT_MS + 100);
+  TEST_ASSERT_TRUE(model.idle);
+  const PortReading &r = model.ports[0];
+  TEST_ASSERT_INT_WITHIN(ADC_SCALE, 0, r.refDrift);
+
+  detectors(FWD_FLOOR, REF_FLOOR + IDLE_DRIFT);
+  adcReads = 0;
+  unsigned long start = millis();
+  uint32_t passes = 0;
+  while (millis() - start < IDLE_TRACK_MS)
+  {
+    idleLoop();
+    passes++;
+  }
+  TEST_ASSERT_INT_WITHIN(ADC_SCALE, IDLE_DRIFT * ADC_SCALE, r.refDrift);
+  TEST_ASSERT_INT_WITHIN(ADC_SCALE, 0, r.fwdDrift);
+
+  // Each reading is AWG_WINDOW pairs, and at most a tenth of the passes read
+  char message[64];
+  snprintf(message, sizeof(message), "%lu ADC reads in %lu idle passes",
+           static_cast<unsigned long>(adcReads), static_cast<unsigned long>(passes));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_OR_EQUAL(passes / 10 * 2 * AWG_WINDOW, adcReads);
+
+  command("Z0\n");
+  detectors(FWD_FLOOR, REF_FLOOR);
+}
+
+int main()
+{
+  detectors(FWD_FLOOR, REF_FLOOR);
+  FreqCount.count = FREQ_KHZ * 5L;
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_zero_latched_after_power_up);
+  RUN_TEST(test_fixed_clamp_when_off);
+  RUN_TEST(test_drift_from_latched_zero);
+  RUN_TEST(test_floor_tracked_while_idle);
+  return UNITY_END();
+}
@@ -0,0 +1,535 @@
+/**
+ * @file pmmerge.cpp
+ * @brief Linux host tool merging the log streams of several power meters.
+ *
+ * Reads any number of meters at once with epoll, parses their record lines
+ * {"t":<ms>,"f":<kHz>,"i":<dBm>,"r":<dBm>} in place in the receive buffer,
+ * and writes one CSV time series with a row per record, ordered by time:
+ *
+ *   t_ms,dev,port,f_khz,fwd_dbm,ref_dbm
+ *
+ * Time alignment: every meter's clock is synced to the host with the T
+ * command (time.h) at start and every SYNC_MS, so the records carry host
+ * time. A meter that rejects T is aligned by the smallest difference
+ * between the arrival and the record time seen, which tracks its clock up
+ * to the shortest transfer delay. Records are held for a reorder window
+ * before being written, so slightly late streams still merge in order.
+ *
+ * Once a second the records per second, mean forward power, worst (lowest)
+ * return loss and alignment of every meter are reported on stderr.
+ *
+ * With -b the link rate is negotiated with every meter at start, with the
+ * same U and K handshake as pmrecv; a meter that fails it stays at 57600
+ * baud.
+ *
+ * With --bench <n> the tool plays n meters itself on pseudo-terminals,
+ * sending records as fast as they are taken, and reports the merged
+ * records per second.
+ *
+ * Build: g++ -std=c++11 -O2 -Wall -pthread -o pmmerge pmmerge.cpp
+ * Usage: pmmerge [-b <baud>] [-w <ms>] [-o <file>] <device>...
+ *        pmmerge --bench <meters> [-s <seconds>]
+ */
+
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "pmserial.h"
+
+static const unsigned long SYNC_MS = 10000;   // Interval of the clock syncs
+static const size_t BUFFER_SIZE = 1 << 16;     // Receive buffer per meter
+static const int MAX_EVENTS = 16;
+
+// One measurement record.
+struct Record
+{
+  double t;   // Time stamp in ms, host time once aligned
+  double f;   // Frequency in kHz
+  double i;   // Forward power in dBm
+  double r;   // Reflected power in dBm
+  int port;   // Coupler port, 0 if not given
+  int dev;    // Index of the meter
+};
+
+// Orders the records oldest first in the priority queue.
+struct Later
+{
+  bool operator()(const Record &a, const Record &b) const { return a.t > b.t; }
+};
+
+/**
+ * @brief Parses a decimal number in place.
+ *
+ * Handles the sign, integer and fraction digits the meters send, without
+ * copying or terminating the text.
+ *
+ * @param p Start of the number, moved past it.
+ * @param end End of the text.
+ * @param value Parsed number.
+ * @return true if there was at least one digit.
+ */
+static inline bool parseNumber(const char *&p, const char *end, double &value)
+{
+  bool negative = p < end && *p == '-';
+  if (negative)
+    p++;
+
+  const char *start = p;
+  unsigned long long whole = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    whole = whole * 10 + (*p++ - '0');
+
+  static const double scales[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+  unsigned long long fraction = 0;
+  int digits = 0;
+  if (p < end && *p == '.')
+  {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+      if (digits < 9)
+      {
+        fraction = fraction * 10 + (*p - '0');
+        digits++;
+      }
+    }
+  }
+
+  value = whole + fraction / scales[digits];
+  if (negative)
+    value = -value;
+  return p > start;
+}
+
+/**
+ * @brief Parses a record line in place.
+ *
+ * The fields may come in any order; unknown fields make it no record, so
+ * command answers and event lines are skipped.
+ *
+ * @param p Start of the line.
+ * @param end End of the line, without the newline.
+ * @param rec Parsed record.
+ * @return true if the line was a complete record.
+ */
+static bool parseRecord(const char *p, const char *end, Record &rec)
+{
+  if (p == end || *p++ != '{')
+    return false;
+
+  unsigned seen = 0;
+  rec.port = 0;
+  while (p < end && *p == '"')
+  {
+    char key = p[1];
+    if (p + 3 >= end || p[2] != '"' || p[3] != ':')
+      return false;
+    p += 4;
+
+    double value;
+    if (!parseNumber(p, end, value))
+      return false;
+    switch (key)
+    {
+    case 't': rec.t = value; seen |= 1; break;
+    case 'f': rec.f = value; seen |= 2; break;
+    case 'i': rec.i = value; seen |= 4; break;
+    case 'r': rec.r = value; seen |= 8; break;
+    case 'p': rec.port = static_cast<int>(value); break;
+    default: return false;
+    }
+
+    if (p < end && *p == ',')
+      p++;
+  }
+  return p < end && *p == '}' && seen == 15;
+}
+
+/**
+ * @brief One meter's stream: the receive buffer, clock alignment and statistics.
+ */
+struct Meter
+{
+  const char *name;
+  int fd = -1;
+  char buf[BUFFER_SIZE];
+  size_t len = 0;
+
+  bool synced = false;       // Meter accepted the clock sync
+  double offset = 0;         // Host time minus record time in ms, without a sync
+  bool offsetValid = false;
+  unsigned long long lastSync = 0;
+
+  // Statistics of the current second
+  unsigned long records = 0;
+  unsigned long bad = 0;
+  double fwdSum = 0;
+  double worstRl = 0;        // Lowest return loss, valid when records > 0
+};
+
+/**
+ * @brief Merges the meters' streams into the time-ordered CSV output.
+ */
+class Merger
+{
+private:
+  std::vector<Meter *> &meters;
+  FILE *out;
+  double window;   // Reorder window in ms
+  unsigned long long start = nowUs();
+  std::priority_queue<Record, std::vector<Record>, Later> pending;
+  double newest = 0; // Newest aligned record time seen
+  unsigned long long written = 0;
+
+  // Host time in ms since the tool started.
+  double hostMs() const { return (nowUs() - start) / 1000.0; }
+
+  // Handles one line of a meter.
+  void line(Meter &m, int dev, const char *p, const char *end)
+  {
+    Record rec;
+    if (!parseRecord(p, end, rec))
+    {
+      static const char okT[] = "{\"ok\":\"T\"}";
+      if (end - p == sizeof(okT) - 1 && memcmp(p, okT, sizeof(okT) - 1) == 0)
+        m.synced = true;
+      else if (end - p < 3 || p[0] != '{' || p[1] != '"')
+        m.bad++; // Not JSON, e.g. cut by a rate switch
+      return;
+    }
+
+    if (!m.synced)
+    {
+      // Smallest delay seen is the best estimate of the clock offset
+      double offset = hostMs() - rec.t;
+      if (!m.offsetValid || offset < m.offset)
+        m.offset = offset;
+      m.offsetValid = true;
+      rec.t += m.offset;
+    }
+
+    rec.dev = dev;
+    m.records++;
+    m.fwdSum += rec.i;
+    if (m.records == 1 || rec.i - rec.r < m.worstRl)
+      m.worstRl = rec.i - rec.r;
+    if (rec.t > newest)
+      newest = rec.t;
+    pending.push(rec);
+  }
+
+public:
+  Merger(std::vector<Meter *> &m, FILE *o, double w) : meters(m), out(o), window(w)
+  {
+    fputs("t_ms,dev,port,f_khz,fwd_dbm,ref_dbm\n", out);
+  }
+
+  unsigned long long count() const { return written; }
+
+  // Syncs the clocks of the meters due for it.
+  void sync(bool all)
+  {
+    unsigned long long now = nowMs();
+    for (size_t i = 0; i < meters.size(); i++)
+    {
+      Meter &m = *meters[i];
+      if (!all && now - m.lastSync < SYNC_MS)
+        continue;
+      char cmd[32];
+      snprintf(cmd, sizeof(cmd), "T%llu\n", nowUs() - start);
+      send(m.fd, cmd);
+      m.lastSync = now;
+    }
+  }
+
+  /**
+   * @brief Reads what a meter has sent and parses its complete lines.
+   *
+   * Reads once per call, so a fast meter cannot starve the others; epoll
+   * reports it again while data is left.
+   *
+   * @return false if the meter is gone.
+   */
+  bool read(int dev)
+  {
+    Meter &m = *meters[dev];
+    if (m.len == sizeof(m.buf))
+    {
+      m.bad++; // Line longer than the buffer
+      m.len = 0;
+    }
+    ssize_t n = ::read(m.fd, m.buf + m.len, sizeof(m.buf) - m.len);
+    if (n == 0)
+      return false;
+    if (n < 0)
+      return errno == EAGAIN || errno == EINTR;
+
+    const char *p = m.buf;
+    const char *end = m.buf + m.len + n;
+    const char *eol;
+    while ((eol = static_cast<const char *>(memchr(p, '\n', end - p))) != NULL)
+    {
+      const char *last = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+      line(m, dev, p, last);
+      p = eol + 1;
+    }
+    m.len = end - p;
+    memmove(m.buf, p, m.len);
+    return true;
+  }
+
+  /**
+   * @brief Writes the records older than the reorder window.
+   *
+   * @param all Write everything, at exit.
+   */
+  void flush(bool all)
+  {
+    char row[160];
+    while (!pending.empty() && (all || pending.top().t < newest - window))
+    {
+      const Record &r = pending.top();
+      int n = snprintf(row, sizeof(row), "%.3f,%d,%d,%.0f,%.3f,%.3f\n", r.t, r.dev, r.port, r.f, r.i, r.r);
+      fwrite(row, 1, n, out);
+      pending.pop();
+      written++;
+    }
+  }
+
+  // Reports the statistics of the last second and starts new ones.
+  void report(double seconds)
+  {
+    for (size_t i = 0; i < meters.size(); i++)
+    {
+      Meter &m = *meters[i];
+      fprintf(stderr, "pmmerge: %s: %.0f records/s, fwd %.2f dBm, worst rl %.2f dB, %s %.3f ms, %lu bad\n",
+              m.name, m.records / seconds, m.records ? m.fwdSum / m.records : 0.0, m.worstRl,
+              m.synced ? "synced" : "offset", m.synced ? 0.0 : m.offset, m.bad);
+      m.records = 0;
+      m.fwdSum = 0;
+      m.worstRl = 0;
+    }
+  }
+};
+
+/**
+ * @brief Runs the event loop until stopped or all meters are gone.
+ *
+ * @param seconds Stop after this long, 0 to run until a signal.
+ * @param quiet Leave out the statistics reports.
+ */
+static int run(std::vector<Meter *> &meters, Merger &merger, bool doSync, double seconds, bool quiet)
+{
+  int ep = epoll_create1(0);
+  for (size_t i = 0; i < meters.size(); i++)
+  {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    epoll_ctl(ep, EPOLL_CTL_ADD, meters[i]->fd, &ev);
+  }
+
+  if (doSync)
+    merger.sync(true);
+
+  size_t open = meters.size();
+  unsigned long long started = nowMs();
+  unsigned long long last = started;
+  while (!stop && open > 0)
+  {
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(ep, events, MAX_EVENTS, 100);
+    for (int e = 0; e < n; e++)
+    {
+      int dev = events[e].data.u32;
+      if (!merger.read(dev))
+      {
+        epoll_ctl(ep, EPOLL_CTL_DEL, meters[dev]->fd, NULL);
+        fprintf(stderr, "pmmerge: %s closed\n", meters[dev]->name);
+        open--;
+      }
+    }
+    merger.flush(false);
+    if (doSync)
+      merger.sync(false);
+
+    unsigned long long now = nowMs();
+    if (now - last >= 1000)
+    {
+      if (!quiet)
+        merger.report((now - last) / 1000.0);
+      last = now;
+    }
+    if (seconds > 0 && now - started >= seconds * 1000)
+      break;
+  }
+  merger.flush(true);
+  close(ep);
+  return 0;
+}
+
+/**
+ * @brief Plays one meter on a pseudo-terminal as fast as it is read.
+ *
+ * The record text is formatted once per batch and only the time stamp
+ * digits change, so the writer is not the bottleneck of the benchmark.
+ */
+static void playMeter(int fd, int dev, std::atomic<bool> &done)
+{
+  char batch[8192];
+  unsigned long long t = 0;
+  while (!done)
+  {
+    size_t len = 0;
+    while (len + 80 < sizeof(batch))
+    {
+      t++;
+      len += snprintf(batch + len, sizeof(batch) - len,
+                      "{\"t\":%llu.%03llu,\"f\":%d,\"i\":40.123,\"r\":20.456}\n",
+                      t / 1000, t % 1000, 14000 + dev);
+    }
+    for (size_t sent = 0; sent < len && !done;)
+    {
+      ssize_t n = write(fd, batch + sent, len - sent);
+      if (n > 0)
+        sent += n;
+      else
+        usleep(100);
+    }
+  }
+}
+
+// Measures the merged records per second from simulated meters.
+static int bench(int count, double seconds)
+{
+  std::vector<Meter *> meters;
+  std::vector<int> masters;
+  std::vector<std::string> names(count);
+  std::atomic<bool> done(false);
+  std::vector<std::thread> players;
+
+  for (int i = 0; i < count; i++)
+  {
+    int master = openPty(names[i]);
+    Meter *m = new Meter;
+    m->name = names[i].c_str();
+    m->fd = master < 0 ? -1 : open(m->name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (m->fd < 0 || !setBaud(m->fd, DEFAULT_BAUD))
+    {
+      perror("pmmerge: pseudo-terminal");
+      return 1;
+    }
+    // The players must not block in write() once the merger has stopped
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    meters.push_back(m);
+    masters.push_back(master);
+    players.push_back(std::thread(playMeter, master, i, std::ref(done)));
+  }
+
+  FILE *null = fopen("/dev/null", "w");
+  Merger merger(meters, null, 50);
+  unsigned long long t0 = nowUs();
+  run(meters, merger, false, seconds, true);
+  double elapsed = (nowUs() - t0) / 1e6;
+
+  done = true;
+  for (size_t i = 0; i < players.size(); i++)
+    players[i].join();
+  fclose(null);
+  printf("pmmerge: %d meters, %llu records in %.2f s, %.0f records/s\n",
+         count, merger.count(), elapsed, merger.count() / elapsed);
+  for (size_t i = 0; i < meters.size(); i++)
+  {
+    close(meters[i]->fd);
+    close(masters[i]);
+    delete meters[i];
+  }
+  return 0;
+}
+
+static void onSignal(int)
+{
+  stop = 1;
+}
+
+static int usage()
+{
+  fprintf(stderr, "usage: pmmerge [-b <baud>] [-w <ms>] [-o <file>] <device>...\n"
+                  "       pmmerge --bench <meters> [-s <seconds>]\n");
+  return 2;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long baud = DEFAULT_BAUD;
+  double window = 200;
+  double seconds = 5;
+  int benchMeters = 0;
+  const char *output = NULL;
+  std::vector<Meter *> meters;
+
+  for (int i = 1; i < argc; i++)
+  {
+    bool more = i + 1 < argc;
+    if (strcmp(argv[i], "-b") == 0 && more)
+      baud = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "-w") == 0 && more)
+      window = atof(argv[++i]);
+    else if (strcmp(argv[i], "-o") == 0 && more)
+      output = argv[++i];
+    else if (strcmp(argv[i], "-s") == 0 && more)
+      seconds = atof(argv[++i]);
+    else if (strcmp(argv[i], "--bench") == 0 && more)
+      benchMeters = atoi(argv[++i]);
+    else if (argv[i][0] != '-')
+    {
+      Meter *m = new Meter;
+      m->name = argv[i];
+      meters.push_back(m);
+    }
+    else
+      return usage();
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  if (benchMeters > 0)
+    return bench(benchMeters, seconds);
+  if (meters.empty())
+    return usage();
+
+  for (size_t i = 0; i < meters.size(); i++)
+  {
+    Meter &m = *meters[i];
+    m.fd = open(m.name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (m.fd < 0 || !setBaud(m.fd, DEFAULT_BAUD))
+    {
+      perror(m.name);
+      return 1;
+    }
+    if (baud != DEFAULT_BAUD)
+    {
+      LineReader in(m.fd);
+      std::string name = std::string("pmmerge: ") + m.name;
+      fprintf(stderr, "%s at %lu baud\n", name.c_str(), negotiate(name.c_str(), m.fd, in, baud, true));
+    }
+  }
+
+  FILE *out = output ? fopen(output, "w") : stdout;
+  if (out == NULL)
+  {
+    perror(output);
+    return 1;
+  }
+  Merger merger(meters, out, window);
+  int status = run(meters, merger, true, 0, false);
+  fprintf(stderr, "pmmerge: %llu records written\n", merger.count());
+  if (out != stdout)
+    fclose(out);
+  return status;
+}
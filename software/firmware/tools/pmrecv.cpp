@@ -0,0 +1,356 @@
+/**
+ * @file pmrecv.cpp
+ * @brief Linux host receiver for the power meter's serial log stream.
+ *
+ * Negotiates the high-speed link of link.h with the U and K commands, falls
+ * back to 57600 baud like the meter does when the handshake fails, and then
+ * copies every record line to stdout. Once a second the records and bytes
+ * per second and the number of malformed lines are reported on stderr.
+ *
+ * With --sim the program plays the meter instead: it opens a pseudo-terminal,
+ * prints the name of its slave side and answers the handshake and clock sync
+ * there, sending records at the given rate or as fast as the link allows.
+ * Point a second pmrecv, or pmmerge, at the printed device to try them
+ * without hardware.
+ *
+ * With --enob the program measures the noise of the forward power readings
+ * for every averaging window of the A command, 1 to 256 samples, and prints
+ * the readings per second and the effective number of bits of each. The
+ * meter must see a steady carrier meanwhile.
+ *
+ * Build: g++ -std=c++11 -O2 -Wall -o pmrecv pmrecv.cpp
+ * Usage: pmrecv [-b <baud>] <device>
+ *        pmrecv --enob [-n <records>] [-b <baud>] <device>
+ *        pmrecv --sim [-r <records/s>]
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pmserial.h"
+
+static const unsigned long SETTLE_MS = 500;     // Records ignored after a new window
+static const unsigned MAX_WINDOW = 256;         // CMD_MAX_AVG_WINDOW of the meter
+static const unsigned DEFAULT_WINDOW = 16;      // AWG_WINDOW of the meter
+static const double FWD_SLOPE = 0.02452;        // Forward detector dB per mV, calc.h
+static const double FULL_SCALE = 4096;          // ADC steps of 1 mV
+static const double LOG_STEP = 0.001;           // Resolution of the logged dBm
+static const double SIM_FWD_MV = 1500.3;        // Forward detector voltage played by --sim
+static const double SIM_FWD_DBM = 40.123;       // Forward power at that voltage
+
+static const char USAGE[] = "usage: pmrecv [-b <baud>] <device>\n"
+                            "       pmrecv --enob [-n <records>] [-b <baud>] <device>\n"
+                            "       pmrecv --sim [-r <records/s>]\n";
+
+// Copies the records to stdout and reports the rates once a second.
+static int receive(LineReader &in, unsigned long baud)
+{
+  unsigned long records = 0, bytes = 0, bad = 0;
+  unsigned long long last = nowMs();
+  std::string line;
+
+  while (!stop)
+  {
+    int r = in.next(line, 200);
+    if (r < 0)
+    {
+      fprintf(stderr, "pmrecv: device closed\n");
+      return 1;
+    }
+    if (r > 0)
+    {
+      bytes += line.size() + 2;
+      if (line.size() < 2 || line[0] != '{' || line[line.size() - 1] != '}')
+        bad++;
+      else if (line.compare(0, 5, "{\"t\":") == 0)
+        records++;
+      fwrite(line.data(), 1, line.size(), stdout);
+      fputc('\n', stdout);
+    }
+
+    unsigned long long now = nowMs();
+    if (now - last >= 1000)
+    {
+      double s = (now - last) / 1000.0;
+      fprintf(stderr, "pmrecv: %lu baud, %.0f records/s, %.0f bytes/s, %lu bad lines\n",
+              baud, records / s, bytes / s, bad);
+      fflush(stdout);
+      records = bytes = 0;
+      last = now;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Reads a number field from a record line.
+ *
+ * @return true if the field was found.
+ */
+static bool field(const std::string &line, const char *key, double &value)
+{
+  std::string tag = std::string("\"") + key + "\":";
+  size_t pos = line.find(tag);
+  if (pos == std::string::npos)
+    return false;
+  value = strtod(line.c_str() + pos + tag.size(), NULL);
+  return true;
+}
+
+/**
+ * @brief Measures the noise and effective bits for every averaging window.
+ *
+ * For each window the meter is set with A<n>, the records of the first
+ * SETTLE_MS are dropped and the standard deviation of the next forward
+ * powers is taken. It is converted to ADC steps with the detector slope, and
+ * the effective number of bits is log2(FULL_SCALE / (sigma * sqrt(12))). A
+ * deviation below the resolution of the log is taken as that resolution,
+ * so the result is a lower bound then. The default window is set again at
+ * the end.
+ *
+ * @param count Records per window.
+ */
+static int enob(int fd, LineReader &in, unsigned long count)
+{
+  printf("%6s %10s %12s %12s %7s\n", "window", "records/s", "sigma_dB", "sigma_lsb", "enob");
+  for (unsigned window = 1; window <= MAX_WINDOW && !stop; window *= 2)
+  {
+    char cmd[16];
+    snprintf(cmd, sizeof(cmd), "A%u\n", window);
+    if (!send(fd, cmd) || !answer(in, 'A', ANSWER_MS, true))
+    {
+      fprintf(stderr, "pmrecv: window %u refused\n", window);
+      return 1;
+    }
+
+    std::string line;
+    unsigned long long settled = nowMs() + SETTLE_MS;
+    unsigned long long first = 0;
+    unsigned long n = 0;
+    double mean = 0, m2 = 0, value;
+    while (n < count && !stop)
+    {
+      int r = in.next(line, ANSWER_MS);
+      if (r < 0 || (r == 0 && !stop))
+      {
+        fprintf(stderr, "pmrecv: no records at window %u\n", window);
+        return 1;
+      }
+      if (r == 0 || line.compare(0, 5, "{\"t\":") != 0 || !field(line, "i", value))
+        continue;
+      unsigned long long now = nowMs();
+      if (now < settled)
+        continue;
+      if (n == 0)
+        first = now;
+
+      // Welford's running variance
+      n++;
+      double delta = value - mean;
+      mean += delta / n;
+      m2 += delta * (value - mean);
+    }
+    if (n < 2)
+      break;
+
+    double seconds = (nowMs() - first) / 1000.0;
+    double sigma = sqrt(m2 / (n - 1));
+    double floor = LOG_STEP / sqrt(12.0);
+    double lsb = (sigma > floor ? sigma : floor) / FWD_SLOPE;
+    printf("%6u %10.0f %12.5f %12.4f %7.2f%s\n", window, seconds > 0 ? (n - 1) / seconds : 0.0,
+           sigma, lsb, log2(FULL_SCALE / (lsb * sqrt(12.0))), sigma > floor ? "" : " (at least)");
+    fflush(stdout);
+  }
+
+  char cmd[16];
+  snprintf(cmd, sizeof(cmd), "A%u\n", DEFAULT_WINDOW);
+  send(fd, cmd);
+  return 0;
+}
+
+/**
+ * @brief Plays the meter on a pseudo-terminal for trying out the host tools.
+ *
+ * Answers U, K and the handshake timeout like link.h, T like time.h, and
+ * sends records with a running time stamp, synced to the host after T<us>.
+ * The forward detector voltage is sampled like the meter's ADC, with one
+ * step of noise per sample rounded to whole codes, and averaged over the
+ * window set by A<n> in 1/16 mV like Adc::average().
+ * The baud rate only matters to the handshake, a pseudo-terminal runs at
+ * memory speed.
+ *
+ * @param rate Records per second, 0 for as many as the reader takes.
+ */
+static int simulate(unsigned long rate)
+{
+  std::string name;
+  int fd = openPty(name);
+  if (fd < 0)
+  {
+    perror("pmrecv: pseudo-terminal");
+    return 1;
+  }
+  printf("%s\n", name.c_str());
+  fflush(stdout);
+
+  int flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+  LineReader in(fd);
+  unsigned long baud = DEFAULT_BAUD;
+  unsigned long long switched = 0;
+  bool pending = false;
+  unsigned long long start = nowUs();
+  long long offset = 0; // Host time minus local time in us
+  unsigned long long sent = 0;
+  unsigned long window = DEFAULT_WINDOW;
+  std::string out; // Output not yet taken by the pseudo-terminal
+  std::string line;
+
+  while (!stop)
+  {
+    if (in.next(line, 0) > 0)
+    {
+      char c = line.empty() ? '\0' : line[0];
+      unsigned long long arg = strtoull(line.c_str() + 1, NULL, 10);
+      char reply[64];
+      if (c == 'U' && (arg == DEFAULT_BAUD || arg == 250000 || arg == 500000 || arg == 1000000))
+      {
+        out += "{\"ok\":\"U\"}\n";
+        baud = arg;
+        pending = baud != DEFAULT_BAUD;
+        switched = nowMs();
+        snprintf(reply, sizeof(reply), "{\"link\":%lu}\n", baud);
+        out += reply;
+      }
+      else if (c == 'K' && pending)
+      {
+        pending = false;
+        out += "{\"ok\":\"K\"}\n";
+      }
+      else if (c == 'A' && arg >= 1 && arg <= MAX_WINDOW)
+      {
+        window = arg;
+        out += "{\"ok\":\"A\"}\n";
+      }
+      else if (c == 'T' && line.size() > 1)
+      {
+        offset = static_cast<long long>(arg) - static_cast<long long>(nowUs() - start);
+        out += "{\"ok\":\"T\"}\n";
+      }
+      else
+      {
+        snprintf(reply, sizeof(reply), "{\"err\":\"%c\"}\n", c);
+        out += reply;
+      }
+    }
+
+    if (pending && nowMs() - switched >= HANDSHAKE_MS)
+    {
+      pending = false;
+      baud = DEFAULT_BAUD;
+      out += "{\"link\":57600}\n";
+    }
+
+    // Whole lines only, a record cut by a reply would be garbage
+    if (!out.empty())
+    {
+      ssize_t n = write(fd, out.data(), out.size());
+      if (n > 0)
+        out.erase(0, n);
+      else if (errno == EAGAIN)
+        usleep(1000); // Nobody is reading
+      continue;
+    }
+
+    unsigned long long local = nowUs() - start;
+    if (rate != 0 && sent >= local * rate / 1000000)
+    {
+      usleep(200);
+      continue;
+    }
+
+    // Codes with a sum of uniform samples as noise, a standard deviation of
+    // one step each, averaged with the rounding of the meter
+    long sum = 0;
+    for (unsigned long n = 0; n < window; n++)
+    {
+      double noise = 0;
+      for (int i = 0; i < 12; i++)
+        noise += drand48();
+      sum += lround(SIM_FWD_MV + noise - 6);
+    }
+    double mv = (sum * 16 + static_cast<long>(window / 2)) / static_cast<long>(window) / 16.0;
+
+    char record[96];
+    unsigned long long us = local + offset;
+    snprintf(record, sizeof(record), "{\"t\":%llu.%03llu,\"f\":14074,\"i\":%.3f,\"r\":20.456}\n",
+             us / 1000, us % 1000, SIM_FWD_DBM + (mv - SIM_FWD_MV) * FWD_SLOPE);
+    out += record;
+    sent++;
+  }
+  return 0;
+}
+
+static void onSignal(int)
+{
+  stop = 1;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long baud = 1000000;
+  unsigned long rate = 0;
+  unsigned long count = 2000;
+  bool sim = false;
+  bool measure = false;
+  const char *device = NULL;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+      baud = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+      rate = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      count = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--sim") == 0)
+      sim = true;
+    else if (strcmp(argv[i], "--enob") == 0)
+      measure = true;
+    else if (argv[i][0] != '-' && device == NULL)
+      device = argv[i];
+    else
+    {
+      fprintf(stderr, USAGE);
+      return 2;
+    }
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  if (sim)
+    return simulate(rate);
+  if (device == NULL)
+  {
+    fprintf(stderr, USAGE);
+    return 2;
+  }
+
+  int fd = open(device, O_RDWR | O_NOCTTY);
+  if (fd < 0 || !setBaud(fd, DEFAULT_BAUD))
+  {
+    perror(device);
+    return 1;
+  }
+
+  LineReader in(fd);
+  baud = negotiate("pmrecv", fd, in, baud, measure);
+  fprintf(stderr, "pmrecv: receiving at %lu baud\n", baud);
+  int status = measure ? enob(fd, in, count) : receive(in, baud);
+  close(fd);
+  return status;
+}
@@ -0,0 +1,229 @@
+/**
+ * @file pmserial.h
+ * @brief Serial port helpers and the rate handshake shared by the host tools.
+ */
+
+#pragma once
+
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+static const unsigned long DEFAULT_BAUD = 57600; // LINK_DEFAULT_BAUD of the meter
+static const unsigned long HANDSHAKE_MS = 1000;  // LINK_HANDSHAKE_MS of the meter
+static const unsigned long ANSWER_MS = 2000;     // Time to wait for a command answer
+static const unsigned long CONFIRM_MS = 100;     // Interval of the K retries
+
+static volatile sig_atomic_t stop = 0; // Set by the tools' signal handlers
+
+// Milliseconds from a monotonic clock.
+static inline unsigned long long nowMs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+// Microseconds from a monotonic clock.
+static inline unsigned long long nowUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Puts a terminal into raw 8N1 mode at any baud rate.
+ *
+ * Uses termios2 with BOTHER, so rates without a Bxxx constant such as 250000
+ * work too.
+ *
+ * @return true on success.
+ */
+static inline bool setBaud(int fd, unsigned long baud)
+{
+  struct termios2 tio;
+  if (ioctl(fd, TCGETS2, &tio) < 0)
+    return false;
+
+  tio.c_iflag = 0;
+  tio.c_oflag = 0;
+  tio.c_lflag = 0;
+  tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER | (BOTHER << IBSHIFT);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  tio.c_ispeed = baud;
+  tio.c_ospeed = baud;
+  return ioctl(fd, TCSETS2, &tio) == 0;
+}
+
+// Writes a whole string, waiting for the output to drain.
+static inline bool send(int fd, const std::string &s)
+{
+  size_t done = 0;
+  while (done < s.size())
+  {
+    ssize_t n = write(fd, s.data() + done, s.size() - done);
+    if (n < 0 && errno != EINTR && errno != EAGAIN)
+      return false;
+    if (n > 0)
+      done += n;
+  }
+  return ioctl(fd, TCSBRK, 1) == 0 || errno == ENOTTY || errno == EINVAL;
+}
+
+/**
+ * @brief Opens a pseudo-terminal to play a meter on.
+ *
+ * @param name Receives the name of the slave side to open as the meter.
+ * @return The master side in raw mode, or -1 on error.
+ */
+static inline int openPty(std::string &name)
+{
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0)
+    return -1;
+  setBaud(fd, DEFAULT_BAUD); // Raw mode, so the records are not echoed back
+  name = ptsname(fd);
+  return fd;
+}
+
+/**
+ * @brief Splits the byte stream of a terminal into lines.
+ */
+class LineReader
+{
+private:
+  int fd;
+  std::string buf;
+
+public:
+  explicit LineReader(int f) : fd(f) {}
+
+  /**
+   * @brief Reads the next complete line, without its line end.
+   *
+   * @param line Line read.
+   * @param timeoutMs Longest time to wait for more data.
+   * @return 1 for a line, 0 on timeout, -1 on error or end of file.
+   */
+  int next(std::string &line, unsigned long timeoutMs)
+  {
+    unsigned long long deadline = nowMs() + timeoutMs;
+    for (;;)
+    {
+      size_t eol = buf.find('\n');
+      if (eol != std::string::npos)
+      {
+        line.assign(buf, 0, eol);
+        buf.erase(0, eol + 1);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+          line.erase(line.size() - 1);
+        return 1;
+      }
+
+      if (stop)
+        return 0;
+      unsigned long long now = nowMs();
+      unsigned long long left = deadline > now ? deadline - now : 0;
+
+      fd_set set;
+      FD_ZERO(&set);
+      FD_SET(fd, &set);
+      struct timeval tv;
+      tv.tv_sec = left / 1000;
+      tv.tv_usec = left % 1000 * 1000;
+      int r = select(fd + 1, &set, NULL, NULL, &tv);
+      if (r < 0 && errno != EINTR)
+        return -1;
+      if (r == 0)
+        return 0; // Timed out
+      if (r < 0)
+        continue;
+
+      char chunk[4096];
+      ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n < 0 && errno != EINTR && errno != EAGAIN)
+        return -1;
+      if (n == 0)
+        return -1;
+      if (n > 0)
+        buf.append(chunk, n);
+    }
+  }
+};
+
+/**
+ * @brief Waits for the meter's answer to a command.
+ *
+ * Record lines arriving meanwhile are passed to stdout unless dropped.
+ *
+ * @return true for {"ok":"<cmd>"}, false for {"err":"<cmd>"} or a timeout.
+ */
+static inline bool answer(LineReader &in, char cmd, unsigned long timeoutMs, bool drop = false)
+{
+  std::string ok = std::string("{\"ok\":\"") + cmd + "\"}";
+  std::string err = std::string("{\"err\":\"") + cmd + "\"}";
+  unsigned long long deadline = nowMs() + timeoutMs;
+  std::string line;
+  for (unsigned long long now = nowMs(); now < deadline; now = nowMs())
+  {
+    if (in.next(line, deadline - now) <= 0)
+      return false;
+    if (line == ok)
+      return true;
+    if (line == err)
+      return false;
+    if (!drop && line.compare(0, 5, "{\"t\":") == 0)
+      printf("%s\n", line.c_str());
+  }
+  return false;
+}
+
+/**
+ * @brief Switches the meter and the terminal to a new baud rate.
+ *
+ * Sends U<baud> at the current rate, switches after the answer and confirms
+ * with K until the meter answers. On failure the terminal is returned to
+ * the default rate, where the meter falls back by itself.
+ *
+ * @param name Prefix of the messages on stderr.
+ * @param drop Drop the records arriving meanwhile instead of passing them.
+ * @return The rate in use afterwards.
+ */
+static inline unsigned long negotiate(const char *name, int fd, LineReader &in, unsigned long baud, bool drop)
+{
+  if (baud == DEFAULT_BAUD)
+    return baud;
+
+  char cmd[24];
+  snprintf(cmd, sizeof(cmd), "U%lu\n", baud);
+  if (!send(fd, cmd) || !answer(in, 'U', ANSWER_MS, drop))
+  {
+    fprintf(stderr, "%s: %lu baud refused\n", name, baud);
+    return DEFAULT_BAUD;
+  }
+
+  if (setBaud(fd, baud))
+  {
+    // The meter switches once its answer has gone out, so K may need a retry
+    for (unsigned long waited = 0; waited + CONFIRM_MS < HANDSHAKE_MS; waited += CONFIRM_MS)
+    {
+      if (send(fd, "K\n") && answer(in, 'K', CONFIRM_MS, drop))
+        return baud;
+    }
+  }
+
+  fprintf(stderr, "%s: no handshake at %lu baud, falling back to %lu\n", name, baud, DEFAULT_BAUD);
+  usleep(HANDSHAKE_MS * 1000);
+  setBaud(fd, DEFAULT_BAUD);
+  return DEFAULT_BAUD;
+}